@@ -3,40 +3,145 @@
 /*
  * Homework 2
  * A shell which supports piping, IO redirection, and some signal handling.
- * Native commands include:
- *    quit/exit: terminate the shell
+ * Every stage of a pipeline runs at the same time, all in one process group,
+ * and the shell waits for all of them.
+ * Usage:
+ *    shell: read commands from stdin. From a terminal, with a prompt and job
+ *        control. Otherwise (a pipe or a file) as a script, quietly.
+ *    shell file: run the script in the file
+ *    shell -c command: run the command(s) given
+ * At the end of a script, the shell exits with the last command's status.
+ * Words can be quoted with '...' or "..." and characters escaped with \,
+ * and # starts a comment.
+ * Native commands (builtins) include:
+ *    quit/exit [n]: terminate the shell, with status n or the last status
  *    pwd: print the current working directory via getcwd
  *    cd [path]: change the current working directory to the given path via chdir
- * If a command is not native, it is executed using execvp.
- * If a command run by execvp is invalid/DNE then an error message is displayed.
+ *    echo [-n] [args]: print the arguments
+ *    export [name=value]: set an environment variable, or list them all
+ *    true/false: succeed/fail
+ *    jobs: list the background and stopped pipelines
+ *    wait [%job]: wait for a background pipeline, or all of them
+ *    hash [-r] [command]: list, forget or look up the paths of commands
+ *    spawnbench count command [args]: time launching an external command with each launcher
+ * A native command that is the whole line runs in the shell itself, so cd
+ * changes the shell's directory and no process is created. In a pipeline
+ * or in the background it runs in a forked copy of the shell.
+ * If a command is not native, it is started with posix_spawn, which doesn't
+ * copy the shell the way fork does. Where it is in PATH is remembered after
+ * the first time, until PATH changes.
+ * If a command run by posix_spawn is invalid/DNE then an error message is displayed.
  */
 
+#define _GNU_SOURCE // pipe2, posix_spawn_file_actions_addtcsetpgrp_np
 #include <stdio.h>
 #include <time.h> // getting current time
 #include <signal.h> // signal handling
 #include <sys/types.h> // pid_t
 #include <stdlib.h> // exit() and wait()
-#include <unistd.h> // fork, execvp, chdir
-#include <string.h> // 'int strncmp(char[], char[], int limit)'
+#include <unistd.h> // fork, execv, chdir
+#include <string.h> // strcmp, memchr
 #include <fcntl.h> // for IO redirection
+#include <sys/wait.h> // waitpid
+#include <errno.h> // EINTR, ENOENT, ENOEXEC
+#include <spawn.h> // posix_spawn
+#include <sys/stat.h> // stat, for finding commands
 
-#define MAX_LEN 300 // Arbitrary maximum length of a single shell command. Can be changed.
-#define MAX_ARGS 30 // Arbitrary maximum argument count accepted. Can be changed.
+#define READ_BLOCK 65536 // Bytes of input read at a time. Can be changed.
 #define MAX_WD 300 // Arbitrary maximum string length for 'pwd' result. Can be changed.
 #define MAX_INTMESSAGE_LEN 100 // used in signal_handler(int) as the max message length.
+#define MAX_JOBS 32 // Arbitrary maximum number of background/stopped pipelines. Can be changed.
+#define BUILTIN_SLOTS 64 // Size of the builtin hash table, a power of 2 well above the builtin count.
+#define PATH_SLOTS 256 // Size of the command path hash table, a power of 2. Can be changed.
 #define PROMPT " > "
+#define OPERATORS "|<>&" // characters that are words of their own
+#define OPERATOR_COUNT 4
+
+// Reads input a block at a time and hands it out a line at a time
+struct reader {
+    int fd; // -1 when reading a string
+    char* block;
+    size_t size;
+    size_t start; // block[start..end) is read but not handed out yet
+    size_t end;
+};
+
+// Memory for the words of a line, kept from line to line
+struct tokens {
+    char* chars;
+    size_t chars_size;
+    char** args;
+    size_t args_size;
+};
+
+// A native command. run returns its exit status.
+struct builtin {
+    char* name;
+    int (*run)(char** args, int arg_count);
+};
+
+// Where a command was found in PATH, in a chain of path_table
+struct path_entry {
+    char* name;
+    char* path;
+    int hits; // times it was looked up
+    struct path_entry* next;
+};
+
+// A pipeline running in the background, or stopped
+struct job {
+    pid_t pgid; // 0 if this slot is free
+    pid_t* pids; // the stages, 0 once one has been reaped
+    int stage_count;
+    int status; // exit status of the last stage, once it's done
+    int stopped;
+    char* command; // the line that started it
+};
 
 // Execution
 void exe_line(char** args, int arg_count);
-void exe_line2(char** args, int arg_count);
-void exe_command(char** args, int arg_count);
+void exe_pipeline(char** args, int arg_count, char* in_file, char* out_file, int background, char* command);
+int exe_in_shell(struct builtin* b, char** args, int arg_count, int in_fd, int out_fd);
+pid_t launch_stage(char** args, int arg_count, int in_fd, int out_fd, pid_t pgid, int foreground);
+int wait_pipeline(pid_t* pids, int stage_count, pid_t pgid);
 void exe_func(char** args, int arg_count);
 // Execution helpers
-int parse_line(char str[], char* args[]);
+int parse_line(struct tokens* t, char* line, size_t length);
+int is_operator(char* arg, char* op);
+int exit_status(int status);
+
+// Builtins
+void builtin_init();
+struct builtin* builtin_find(char* name);
+int builtin_exit(char** args, int arg_count);
+int builtin_pwd(char** args, int arg_count);
+int builtin_cd(char** args, int arg_count);
+int builtin_echo(char** args, int arg_count);
+int builtin_export(char** args, int arg_count);
+int builtin_true(char** args, int arg_count);
+int builtin_false(char** args, int arg_count);
+int builtin_jobs(char** args, int arg_count);
+int builtin_wait(char** args, int arg_count);
+int builtin_hash(char** args, int arg_count);
+int spawn_bench(char** args, int arg_count);
+
+// Jobs
+void job_add(pid_t pgid, pid_t* pids, int stage_count, char* command, int stopped);
+void job_update(pid_t pid, int status);
+void job_reap();
+void job_free(struct job* j);
+
+// Command paths
+char* path_find(char* name);
+void path_forget(char* name);
+void path_clear();
+
+// Input
+void reader_init(struct reader* r, int fd, char* text);
+char* read_line(struct reader* r, size_t* length);
+void reader_sync(struct reader* r);
 
 // IO Redirection
-void redirect_output_name(char* file);
-void redirect_input_name(char* file);
 void redirect_output_id(int file_id);
 void redirect_input_id(int file_id);
 
@@ -49,49 +154,113 @@ void error(char* string);
 
 // Misc helpers
 int str_equals(char* arg, char compare[]);
-int index_of_str(char** args, int arg_count, char* s);
+char* join_args(char** args, int arg_count);
+char** script_args(char* path, char** args, int arg_count);
+unsigned int hash_name(char* name);
 void errorAndTerminate();
 
-int main() {
+// Exit status of the last stage of the last pipeline waited for.
+// 128 + the signal number if it was killed by a signal.
+int last_status = 0;
+// 1 if the shell reads from a terminal, so jobs are given the terminal while they run
+int interactive = 0;
+// 1 to start every stage with fork, as spawnbench does to compare
+int force_fork = 0;
+
+struct builtin builtins[] = {
+    {"quit", builtin_exit},
+    {"exit", builtin_exit},
+    {"pwd", builtin_pwd},
+    {"cd", builtin_cd},
+    {"echo", builtin_echo},
+    {"export", builtin_export},
+    {"true", builtin_true},
+    {"false", builtin_false},
+    {"jobs", builtin_jobs},
+    {"wait", builtin_wait},
+    {"hash", builtin_hash},
+    {"spawnbench", spawn_bench},
+};
+// builtins hashed by name, see builtin_init
+struct builtin* builtin_table[BUILTIN_SLOTS];
+
+struct job jobs[MAX_JOBS];
+
+// commands' paths hashed by name, see path_find
+struct path_entry* path_table[PATH_SLOTS];
+
+// the operators as parse_line puts them in a line's words, see is_operator
+char operators[OPERATOR_COUNT][2] = {"|", "<", ">", "&"};
+// where the commands are read from
+struct reader input;
+
+int main(int argc, char* argv[]) {
     // Add signal interrupt handler first
     signal(SIGINT, signal_handler);
     signal(SIGTSTP, signal_handler);
+    // The shell hands the terminal to each pipeline and takes it back,
+    // which it can't do from the background without ignoring this.
+    signal(SIGTTOU, SIG_IGN);
+    builtin_init();
 
-    // Startup message
-    printf(" _____                     _____ _       _ _ \n");
-    printf("|   __|_ _ ___ ___ ___ ___|   __| |_ ___| | |\n");
-    printf("|__   | | | . | -_|  _|___|__   |   | -_| | |\n");
-    printf("|_____|___|  _|___|_|     |_____|_|_|___|_|_|\n");
-    printf("          |_|                            v2  \n");
-    printf("Welcome to Super-Shell by Collin Shoop!\n");
-    char command_line[MAX_LEN];
-    char *args[MAX_ARGS + 1];
-    int running = 1;
-
-    while (running) // Main loop: until 'running' is false.
-    {
-        prompt();
-        fflush(stdout);
-        fgets(command_line, MAX_LEN, stdin); // get the line typed
+    // Where the commands come from: -c's string, a script, or stdin
+    if (argc > 1 && str_equals(argv[1], "-c")) {
+        if (argc < 3) {
+            error("Usage: 'shell [-c command | file]'");
+            return 2;
+        }
+        reader_init(&input, -1, argv[2]);
+    } else if (argc > 1) {
+        int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            error("Could not open file.");
+            return 127;
+        }
+        reader_init(&input, fd, NULL);
+    } else {
+        reader_init(&input, STDIN_FILENO, NULL);
+        interactive = isatty(STDIN_FILENO);
+    }
 
-        int arg_count = parse_line(command_line, args); // parse 'command_line' into arguments
+    if (interactive) {
+        // Startup message
+        printf(" _____                     _____ _       _ _ \n");
+        printf("|   __|_ _ ___ ___ ___ ___|   __| |_ ___| | |\n");
+        printf("|__   | | | . | -_|  _|___|__   |   | -_| | |\n");
+        printf("|_____|___|  _|___|_|     |_____|_|_|___|_|_|\n");
+        printf("          |_|                            v2  \n");
+        printf("Welcome to Super-Shell by Collin Shoop!\n");
+    }
+    struct tokens words = {NULL, 0, NULL, 0};
 
-        if (arg_count == -1) { // check for MAX_ARGS exceeded
-            printf("The number of arguments entered exceeds the limit. Ignored.\n");
+    while (1) // Main loop: until quit/exit or the end of the input.
+    {
+        // Clean up after background pipelines that finished
+        job_reap();
+        if (interactive) {
+            prompt();
+            fflush(stdout);
+        }
+        size_t length;
+        char* line = read_line(&input, &length);
+        if (line == NULL) {
+            break;
+        }
+
+        int arg_count = parse_line(&words, line, length); // parse 'line' into arguments
+        if (arg_count == -1) {
+            last_status = 2;
             continue;
         } else if (arg_count == 0) { // check for 0 argumentS
             continue;
         }
 
-        // Check for a quit/exit.
-        if (str_equals(args[0], "quit") || str_equals(args[0], "exit")) {
-            printf("Goodbye.\n");
-            running = 0;
-        } else {
-            exe_line(args, arg_count); // execute using execvp
-        }
+        exe_line(words.args, arg_count);
     }
-    return EXIT_SUCCESS;
+    if (interactive) {
+        printf("\nGoodbye.\n");
+    }
+    return last_status;
 }
 
 /**
@@ -99,138 +268,366 @@ int main() {
  * Supports forking in background using "&" as the last valid argument. That is,
  *    if it's included, "&" must be the arg_count'th argument.
  * Supports piping (any number of pipes), input redirection, and output
- *    redirection. Input and output redirection may be used together.
+ *    redirection. Input and output redirection may be used together, at the
+ *    end of the line: input goes to the first stage, output comes from the last.
  * PRECONDITIONS:
  * - args must be NULL terminated. That is, args[arg_count]=NULL.
- * - args must have length <= 'MAX_ARGS+1' (to account for NULL termination).
- * - arg_count must be <= 'MAX_ARGS'.
- * - arg_count must have value < length(args).
+ * - the operators in args must be the ones parse_line puts there.
  */
 void exe_line(char** args, int arg_count) {
+    char* command = join_args(args, arg_count); // for jobs, before it's cut up
 
-    /* 
-     * Will check for & then fork.
-     * Parent: (effectively the shell) 
-     *    Wait for child or go back to prompting (if & is the last argument)
-     * Child:
-     *    Execute the remaining arguments.
-     */
-
-    // if & is found it must be removed before forking
-    // and flagged
+    // if & is found it must be removed and flagged
     int amp = 0;
-    if (arg_count > 0 && str_equals(args[arg_count - 1], "&")) {
+    if (arg_count > 0 && is_operator(args[arg_count - 1], "&")) {
         // Set this argument to null so that it's not 
         // passed as an argument
         args[arg_count - 1] = NULL;
         arg_count--;
         amp = 1;
     }
-    pid_t pid = fork();
-    if (pid != 0) // parent
-    {
-        if (!amp) { // if there is NOT an &
-            while (wait(NULL) != pid); // wait for the child to finish
+
+    // Take the end-line IO redirection off, right to left. If the same
+    // one is given twice the leftmost wins.
+    char* in_file = NULL;
+    char* out_file = NULL;
+    while (arg_count > 2) {
+        if (is_operator(args[arg_count - 2], ">")) { // output redirection
+            out_file = args[arg_count - 1];
+        } else if (is_operator(args[arg_count - 2], "<")) { // input redirection
+            in_file = args[arg_count - 1];
+        } else {
+            break;
         }
-        // if there is an & the parent will leave and go back to prompting
-    } else { // child
-        // execute the remaining arguments
-        exe_line2(args, arg_count);
+        args[arg_count - 2] = NULL; // get rid of the "<" or ">"
+        arg_count -= 2;
     }
-
+    exe_pipeline(args, arg_count, in_file, out_file, amp, command);
+    free(command);
 }
 
 /* 
- * Will recursively check for and process end-line IO redirection.
- * Afterwards, any left over arguments are processed by 'exe_command'
+ * Splits the arguments into stages at the pipes, '|', and starts every
+ * stage at once, each in a child of its own. The stages are put in one
+ * process group, led by the first, so a signal from the terminal reaches
+ * all of them. Each stage's output is piped into the next one's input, so
+ * data streams through the whole pipeline instead of filling up a pipe
+ * that nobody reads yet.
+ * Argument: in_file - file the first stage reads from, or NULL for stdin
+ * Argument: out_file - file the last stage writes to, or NULL for stdout
+ * Argument: background - if 1, go back to prompting without waiting, and
+ *    keep it as a job. Otherwise wait for every stage and set last_status.
+ * Argument: command - the line, as shown by jobs
+ * A native command on its own in the foreground doesn't get a child: it
+ * runs in the shell, with the redirections done around it.
  */
-void exe_line2(char** args, int arg_count) {
+void exe_pipeline(char** args, int arg_count, char* in_file, char* out_file, int background, char* command) {
 
-    // Flag for recursing
-    int recurse = 0;
-    if (arg_count > 2 && str_equals(args[arg_count - 2], ">")) // output redirection
-    {
-        redirect_output_name(args[arg_count - 1]); // redirect output
-        recurse = 1; // flag for recurse
-    } else if (arg_count > 2 && str_equals(args[arg_count - 2], "<")) // input redirection
-    {
-        redirect_input_name(args[arg_count - 1]); // redirect input
-        recurse = 1; // flag for recurse
+    // Split into stages, NULL terminating each one in place
+    char*** stages = malloc(sizeof (char**) * (arg_count + 1));
+    int* counts = malloc(sizeof (int) * (arg_count + 1));
+    pid_t* pids = malloc(sizeof (pid_t) * (arg_count + 1));
+    int stage_count = 0, start = 0, i;
+    for (i = 0; i <= arg_count; i++) {
+        if (i < arg_count && !is_operator(args[i], "|")) {
+            continue;
+        }
+        if (i == start) { // nothing before a pipe, or after the last one. What?
+            error("Invalid piping.");
+            last_status = 2; // a syntax error, like one parse_line finds
+            free(stages);
+            free(counts);
+            free(pids);
+            return;
+        }
+        args[i] = NULL;
+        stages[stage_count] = &args[start];
+        counts[stage_count++] = i - start;
+        start = i + 1;
     }
-    if (recurse) {
-        args[arg_count - 2] = NULL; // get rid of the "<" or ">"
-        exe_line2(args, arg_count - 2); // recurse
 
-        // not sure if needed. Added just in case. This process should eventually end in an error
-        // and EXIT or be overridden by execvp.
+    // The files are opened here rather than in the children, so a stage
+    // started with posix_spawn only has to have them dup'ed into place.
+    // Everything the shell opens is close-on-exec: the stages only keep
+    // what ends up on their stdin and stdout.
+    int in_fd = -1; // what the next stage reads from
+    int out_file_fd = -1;
+    if (in_file != NULL && (in_fd = open(in_file, O_RDONLY | O_CLOEXEC)) == -1) {
+        error("Could not open file.");
+        stage_count = 0;
+    }
+    if (out_file != NULL && stage_count > 0
+            && (out_file_fd = open(out_file, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0666)) == -1) {
+        error("Could not open file.");
+        stage_count = 0;
+    }
+    if (stage_count == 0) {
+        last_status = EXIT_FAILURE;
+    }
+    struct builtin* b = stage_count == 1 && !background ? builtin_find(args[0]) : NULL;
+    if (b != NULL) {
+        last_status = exe_in_shell(b, args, counts[0], in_fd, out_file_fd);
+        free(stages);
+        free(counts);
+        free(pids);
         return;
     }
-    // Execute remaining arguments after IO redirection
-    exe_command(args, arg_count);
+
+    if (in_fd == -1) {
+        reader_sync(&input); // the first stage may read the rest of stdin
+    }
+    fflush(stdout); // so forked stages don't get a copy of what's buffered
+
+    pid_t pgid = 0; // the first stage's pid, once one has started
+    int foreground = interactive && !background;
+    int started;
+    for (started = 0; started < stage_count; started++) {
+        int fd[2] = {-1, -1}; //[0]=input, [1]=output
+        if (started < stage_count - 1 && pipe2(fd, O_CLOEXEC)) {
+            error("Could not create a pipe.");
+            break;
+        }
+        int out_fd = started < stage_count - 1 ? fd[1] : out_file_fd;
+        pid_t pid = launch_stage(stages[started], counts[started], in_fd, out_fd, pgid, foreground);
+        if (pid != -1 && pgid == 0) {
+            pgid = pid;
+        }
+        pids[started] = pid;
+        // The stage has its copies, so the shell's can go
+        if (in_fd != -1) {
+            close(in_fd);
+        }
+        if (fd[1] != -1) {
+            close(fd[1]);
+        }
+        in_fd = fd[0];
+    }
+    if (in_fd != -1) {
+        close(in_fd);
+    }
+    if (out_file_fd != -1) {
+        close(out_file_fd);
+    }
+
+    if (started > 0 && !background) {
+        if (pgid == 0) {
+            last_status = 127; // none of them could be started
+        } else {
+            if (interactive) {
+                tcsetpgrp(STDIN_FILENO, pgid);
+            }
+            last_status = wait_pipeline(pids, started, pgid);
+            if (interactive) {
+                tcsetpgrp(STDIN_FILENO, getpgrp()); // take the terminal back
+            }
+            for (i = 0; i < started && pids[i] <= 0; i++);
+            if (i < started) { // some stages weren't reaped: it was stopped
+                job_add(pgid, pids, started, command, 1);
+            }
+        }
+    } else if (started > 0 && pgid != 0) {
+        job_add(pgid, pids, started, command, 0);
+        last_status = 0;
+    }
+    // if there is an & the shell will leave and go back to prompting
+    free(stages);
+    free(counts);
+    free(pids);
 }
 
-/* 
- * Will recursively check for pipes (left to right), handling pipe IO redirection
- * and execution of functions (with their parameters) left to right.
- * -- Pipe, '|' , found:
- *    a pipe is created and the process will fork. The child will redirect 
- *    output and execute any arguments left of the pipe while the parent waits. 
- *    The parent will redirect input and recurse with 'exe_command'.
- * -- No pipe, '|', found:
- *    No more IO redirection is required. The remaining arguments
- *    are executed using 'exe_func'.
- */
-void exe_command(char** args, int arg_count) {
-    
-    int pipeIndex = index_of_str(args, arg_count, "|");
-    if (pipeIndex == -1) {
-        // No pipes. Execute using exe_func
-        exe_func(args, arg_count);
-        // exe_func will either terminate this process or override it.
-    }
-    if (pipeIndex == 0) { // first argument is a pipe. What?
-        error("Invalid piping.");
-        exit(EXIT_FAILURE);
+/**
+ * Starts one stage of a pipeline in the given process group, reading from
+ * in_fd and writing to out_fd. External commands are started with
+ * posix_spawn on the path from path_find, which glibc does with a vfork-like clone that shares the
+ * shell's memory instead of copying its page tables. The process group,
+ * the signals' default handlers, the redirections and taking the terminal
+ * are all given to it as attributes and file actions, done in the child
+ * before it execs. Native commands run shell code, so they still need a
+ * fork, as does everything while force_fork is set.
+ * Argument: in_fd - file to dup onto stdin, or -1 to leave it
+ * Argument: out_fd - file to dup onto stdout, or -1 to leave it
+ * Argument: pgid - process group to join, or 0 to lead a new one
+ * Argument: foreground - if 1, the stage's group is given the terminal
+ * Return: The process id of the stage, or -1 if it couldn't be started
+ */
+pid_t launch_stage(char** args, int arg_count, int in_fd, int out_fd, pid_t pgid, int foreground) {
+    int native = builtin_find(args[0]) != NULL;
+    char* path = native ? NULL : path_find(args[0]);
+    if (!native && path != NULL && path != args[0] && force_fork && access(path, X_OK) != 0) {
+        // A forked child's failed exec can't tell the shell the path is
+        // stale, so check it here. It was moved or deleted: look again.
+        path_forget(args[0]);
+        path = path_find(args[0]);
+    }
+    if (!native && path == NULL) {
+        error("Invalid command.");
+        return -1;
+    }
+    if (force_fork || native) {
+        pid_t pid = fork();
+        if (pid == 0) // child
+        {
+            // Join the pipeline's process group, and take the terminal if
+            // it runs in the foreground. Both are done by the shell too,
+            // so it doesn't matter which gets there first.
+            if (interactive) {
+                setpgid(0, pgid);
+            }
+            if (foreground) {
+                tcsetpgrp(STDIN_FILENO, pgid != 0 ? pgid : getpid());
+            }
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            signal(SIGTTOU, SIG_DFL);
+            if (in_fd != -1) {
+                redirect_input_id(in_fd);
+            }
+            if (out_fd != -1) {
+                redirect_output_id(out_fd);
+            }
+            exe_func(args, arg_count);
+        }
+        if (pid < 0) {
+            error("Could not fork.");
+            return -1;
+        }
+        if (interactive) {
+            setpgid(pid, pgid != 0 ? pgid : pid);
+        }
+        return pid;
     }
-    
-    // A pipe is found!
-    
-    int fd[2]; //[0]=input, [1]=output
-    pipe(fd);
-    pid_t pid = fork();
-    if (pid == 0) // child
-    {
-        // Redirect output
-        close(fd[0]);
-        redirect_output_id(fd[1]);
 
-        // Modify args and arg_count
-        args[pipeIndex] = NULL;
-        arg_count = pipeIndex;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t defaults;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTOU);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    // Scripts have no job control: their commands stay in the shell's
+    // process group, so ctrl+c reaches them along with the shell
+    posix_spawnattr_setflags(&attr, (interactive ? POSIX_SPAWN_SETPGROUP : 0) | POSIX_SPAWN_SETSIGDEF);
+    posix_spawn_file_actions_init(&actions);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 35)
+    // Without this the first stage may try the terminal before the shell
+    // has given it away. wait_pipeline lets it go on if it gets stopped.
+    if (foreground && pgid == 0) {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+    }
+#endif
+    if (in_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    }
+    if (out_fd != -1) {
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    }
+    pid_t pid;
+    extern char** environ;
+    int failed = posix_spawn(&pid, path, &actions, &attr, args, environ);
+    if (failed == ENOENT && path != args[0]) {
+        // It was moved or deleted since it was found. Look for it again.
+        path_forget(args[0]);
+        path = path_find(args[0]);
+        failed = path != NULL ? posix_spawn(&pid, path, &actions, &attr, args, environ) : ENOENT;
+    }
+    if (failed == ENOEXEC) {
+        // A script without a "#!" line: run it with the shell
+        char** sh_args = script_args(path, args, arg_count);
+        failed = posix_spawn(&pid, "/bin/sh", &actions, &attr, sh_args, environ);
+        free(sh_args);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (failed) {
+        error("Invalid command.");
+        return -1;
+    }
+    return pid;
+}
 
-        // Execute the left half of the command
-        exe_func(args, arg_count);
-    } else { // parent
-        // Redirect input
-        close(fd[1]);
-        redirect_input_id(fd[0]);
+/**
+ * Waits for every stage of a pipeline to finish.
+ * If the pipeline is suspended (ctrl+z) the shell stops waiting and leaves
+ * it stopped. A stage that was stopped for touching the terminal before
+ * the shell gave it to the pipeline is let go on instead.
+ * Argument: pids - the stages' process ids, in order, -1 for the ones that
+ *    couldn't be started. Each is set to 0 once it has been reaped.
+ * Argument: pgid - the pipeline's process group
+ * Return: The exit status of the last stage, or 128 + the signal number
+ *    if a signal ended or stopped it. 127 if it couldn't be started.
+ */
+int wait_pipeline(pid_t* pids, int stage_count, pid_t pgid) {
+    int status = 0, result = 0, i;
+    for (i = 0; i < stage_count; i++) {
+        if (pids[i] <= 0) {
+            result = pids[i] == -1 ? 127 : result;
+            continue;
+        }
+        pid_t done;
+        do {
+            done = waitpid(pids[i], &status, WUNTRACED);
+            if (done > 0 && WIFSTOPPED(status) && interactive
+                    && (WSTOPSIG(status) == SIGTTIN || WSTOPSIG(status) == SIGTTOU)
+                    && tcgetpgrp(STDIN_FILENO) == pgid) {
+                kill(-pgid, SIGCONT);
+                done = -1;
+                errno = EINTR;
+            }
+        } while (done == -1 && errno == EINTR);
+        if (done == -1) {
+            continue;
+        }
+        if (WIFSTOPPED(status)) {
+            printf("\nStopped.\n");
+            return exit_status(status);
+        }
+        pids[i] = 0;
+        result = exit_status(status);
+    }
+    return result;
+}
 
-        // Reassign the front and modify arg_count
-        args += pipeIndex + 1; // same as: args = &args[pipeIndex + 1];
-        arg_count = arg_count - (pipeIndex + 1);
-        
-        // wait for the correct child to terminate
-        while (wait(NULL) != pid);
-        
-        // Execute the right hand of the pipe recursively
-        exe_command(args, arg_count);
+/**
+ * Runs a native command in the shell's own process, with its input and
+ * output redirected for as long as it runs.
+ * Argument: in_fd - file to read from instead of stdin, or -1. Closed after.
+ * Argument: out_fd - file to write to instead of stdout, or -1. Closed after.
+ * Return: The command's exit status
+ */
+int exe_in_shell(struct builtin* b, char** args, int arg_count, int in_fd, int out_fd) {
+    int saved_in = -1, saved_out = -1;
+    fflush(stdout);
+    if (in_fd != -1) {
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3);
+        dup2(in_fd, STDIN_FILENO);
+        close(in_fd);
+    }
+    if (out_fd != -1) {
+        saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+        dup2(out_fd, STDOUT_FILENO);
+        close(out_fd);
+    }
+    int result = b->run(args, arg_count);
+    fflush(stdout);
+    if (saved_in != -1) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    if (saved_out != -1) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
     }
+    return result;
 }
 
 /*
 * Will execute the given arguments.
-* Will either override the current process space using execvp
-* or execute a local command and terminate the current process.
+* Will either override the current process space using execv
+* or execute a native command and terminate the current process
+* with its exit status.
 */
 void exe_func(char** args, int arg_count) {
     
@@ -238,54 +635,650 @@ void exe_func(char** args, int arg_count) {
         errorAndTerminate();
     }
 
-    if (str_equals(args[0], "pwd")) { // execute 'pwd' command
-        // Allocate some memory for the path
-        char *t_path = malloc(sizeof (char) * MAX_WD);
-        // get the path
-        if (!getcwd(t_path, MAX_WD)) { // attempt get of native wd
-            error("Working directory too long to store.");
+    struct builtin* b = builtin_find(args[0]);
+    if (b != NULL) {
+        exit(b->run(args, arg_count));
+    }
+    char* path = path_find(args[0]);
+    if (path != NULL) {
+        execv(path, args);
+        if (errno == ENOEXEC) { // a script without a "#!" line
+            execv("/bin/sh", script_args(path, args, arg_count));
+        }
+    }
+    error("Invalid command.");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Puts every builtin into builtin_table, at the slot its name hashes to
+ * (the next free one if that's taken). The table is sized so that looking
+ * a name up almost always takes one hash and one compare, instead of a
+ * compare with every builtin.
+ */
+void builtin_init() {
+    int i;
+    for (i = 0; i < (int) (sizeof (builtins) / sizeof (builtins[0])); i++) {
+        unsigned int slot = hash_name(builtins[i].name) & (BUILTIN_SLOTS - 1);
+        while (builtin_table[slot] != NULL) {
+            slot = (slot + 1) & (BUILTIN_SLOTS - 1);
         }
-        printf("%s\n", t_path);
+        builtin_table[slot] = &builtins[i];
+    }
+}
+
+/**
+ * Looks a command up in builtin_table.
+ * Return: The builtin with the given name, or NULL if it isn't one
+ */
+struct builtin* builtin_find(char* name) {
+    unsigned int slot = hash_name(name) & (BUILTIN_SLOTS - 1);
+    while (builtin_table[slot] != NULL) {
+        if (str_equals(builtin_table[slot]->name, name)) {
+            return builtin_table[slot];
+        }
+        slot = (slot + 1) & (BUILTIN_SLOTS - 1);
+    }
+    return NULL;
+}
+
+/**
+ * 'quit/exit [n]': terminates the shell with status n, or the status of
+ * the last pipeline if n is left out.
+ */
+int builtin_exit(char** args, int arg_count) {
+    if (interactive) {
+        printf("Goodbye.\n");
+    }
+    exit(arg_count > 1 ? atoi(args[1]) & 0xff : last_status);
+}
+
+/**
+ * 'pwd': prints the current working directory.
+ */
+int builtin_pwd(char** args, int arg_count) {
+    (void) args;
+    (void) arg_count;
+    // Allocate some memory for the path
+    char *t_path = malloc(sizeof (char) * MAX_WD);
+    // get the path
+    if (!getcwd(t_path, MAX_WD)) { // attempt get of native wd
+        error("Working directory too long to store.");
         free(t_path);
-    } else if (str_equals(args[0], "cd")) { // execute 'cd' command
-        if (arg_count < 2) {
-            error("Not enough arguments. Usage: 'cd [path]'");
+        return EXIT_FAILURE;
+    }
+    printf("%s\n", t_path);
+    free(t_path);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * 'cd [path]': changes the current working directory.
+ */
+int builtin_cd(char** args, int arg_count) {
+    if (arg_count < 2) {
+        error("Not enough arguments. Usage: 'cd [path]'");
+        return EXIT_FAILURE;
+    }
+    if (chdir(args[1])) { // attempt native cd
+        error("cd failed");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * 'echo [-n] [args]': prints the arguments separated by spaces, then a
+ * newline unless -n is given.
+ */
+int builtin_echo(char** args, int arg_count) {
+    int newline = !(arg_count > 1 && str_equals(args[1], "-n"));
+    int i;
+    for (i = newline ? 1 : 2; i < arg_count; i++) {
+        fputs(args[i], stdout);
+        if (i < arg_count - 1) {
+            putchar(' ');
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * 'export [name=value]...': sets environment variables, which commands
+ * started after inherit. With no arguments, prints all of them.
+ */
+int builtin_export(char** args, int arg_count) {
+    extern char** environ;
+    int result = EXIT_SUCCESS, i;
+    if (arg_count == 1) {
+        for (i = 0; environ[i] != NULL; i++) {
+            printf("%s\n", environ[i]);
+        }
+    }
+    for (i = 1; i < arg_count; i++) {
+        char* equals = strchr(args[i], '=');
+        if (equals == NULL) {
+            continue; // already exported, every variable the shell has is
+        }
+        *equals = '\0';
+        if (equals == args[i] || setenv(args[i], equals + 1, 1)) {
+            error("Invalid variable. Usage: 'export [name=value]'");
+            result = EXIT_FAILURE;
+        } else if (str_equals(args[i], "PATH")) {
+            path_clear(); // the commands may be somewhere else now
+        }
+        *equals = '=';
+    }
+    return result;
+}
+
+/**
+ * 'true': does nothing, successfully.
+ */
+int builtin_true(char** args, int arg_count) {
+    (void) args;
+    (void) arg_count;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * 'false': does nothing, unsuccessfully.
+ */
+int builtin_false(char** args, int arg_count) {
+    (void) args;
+    (void) arg_count;
+    return EXIT_FAILURE;
+}
+
+/**
+ * 'jobs': lists the pipelines running in the background or stopped.
+ */
+int builtin_jobs(char** args, int arg_count) {
+    (void) args;
+    (void) arg_count;
+    int i;
+    job_reap();
+    for (i = 0; i < MAX_JOBS; i++) {
+        if (jobs[i].pgid != 0) {
+            printf("[%d] %-8s %s\n", i + 1, jobs[i].stopped ? "Stopped" : "Running", jobs[i].command);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * 'wait [%job]...': waits for the given jobs to finish, or for every
+ * running one if none are given. Stopped jobs aren't waited for, since
+ * they wouldn't finish.
+ * Return: The exit status of the last job waited for
+ */
+int builtin_wait(char** args, int arg_count) {
+    int result = EXIT_SUCCESS, i, k;
+    for (i = arg_count > 1 ? 1 : 0; i < arg_count; i++) {
+        int first = 0, last = MAX_JOBS - 1;
+        if (arg_count > 1) {
+            first = last = atoi(args[i][0] == '%' ? &args[i][1] : args[i]) - 1;
+            if (first < 0 || first >= MAX_JOBS || jobs[first].pgid == 0) {
+                error("No such job. Usage: 'wait [%job]'");
+                result = 127;
+                continue;
+            }
+        }
+        for (; first <= last; first++) {
+            struct job* j = &jobs[first];
+            for (k = 0; j->pgid != 0 && !j->stopped && k < j->stage_count; k++) {
+                int status;
+                pid_t done = j->pids[k] > 0 ? waitpid(j->pids[k], &status, WUNTRACED) : 0;
+                if (done > 0) {
+                    job_update(done, status);
+                } else if (done == -1 && errno == EINTR) {
+                    k--; // try that one again
+                }
+            }
+            if (j->pgid != 0 && !j->stopped) {
+                result = j->status;
+                job_free(j);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * 'spawnbench count command [args]': launches the command count times
+ * with fork and then with posix_spawn, its output thrown away, waiting
+ * for each to finish before the next, and prints the average time from
+ * starting one to reaping it. Native commands are refused: both launchers
+ * would fork for them.
+ */
+int spawn_bench(char** args, int arg_count) {
+    int count = arg_count >= 3 ? atoi(args[1]) : 0;
+    if (count < 1) {
+        error("Usage: 'spawnbench [count] [command]'");
+        return EXIT_FAILURE;
+    }
+    if (builtin_find(args[2]) != NULL) {
+        error("spawnbench only times commands that aren't native.");
+        return EXIT_FAILURE;
+    }
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    int method, i;
+    for (method = 0; method < 2; method++) {
+        struct timespec start, end;
+        force_fork = method == 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < count; i++) {
+            pid_t pid = launch_stage(&args[2], arg_count - 2, -1, null_fd, 0, 0);
+            if (pid == -1) {
+                break;
+            }
+            wait_pipeline(&pid, 1, pid);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+        printf("%-11s %d launches, %.1f us each\n", method == 0 ? "fork:" : "posix_spawn:",
+                i, i > 0 ? us / i : 0);
+    }
+    force_fork = 0;
+    close(null_fd);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Keeps track of a pipeline the shell isn't waiting for.
+ * Argument: pids - its stages, 0 or -1 for the ones already reaped or
+ *    never started
+ * Argument: stopped - 1 if it was stopped, 0 if it runs in the background
+ */
+void job_add(pid_t pgid, pid_t* pids, int stage_count, char* command, int stopped) {
+    int i;
+    for (i = 0; i < MAX_JOBS && jobs[i].pgid != 0; i++);
+    if (i == MAX_JOBS) {
+        error("Too many jobs. This one won't be listed.");
+        return;
+    }
+    struct job* j = &jobs[i];
+    j->pgid = pgid;
+    j->pids = malloc(sizeof (pid_t) * stage_count);
+    memcpy(j->pids, pids, sizeof (pid_t) * stage_count);
+    j->stage_count = stage_count;
+    j->status = 0;
+    j->stopped = stopped;
+    j->command = strdup(command);
+    if (interactive) {
+        printf("[%d] %d\n", i + 1, (int) pgid);
+    }
+}
+
+/**
+ * Records what waitpid said about one of the jobs' stages.
+ */
+void job_update(pid_t pid, int status) {
+    int i, k;
+    for (i = 0; i < MAX_JOBS; i++) {
+        struct job* j = &jobs[i];
+        for (k = 0; j->pgid != 0 && k < j->stage_count; k++) {
+            if (j->pids[k] != pid) {
+                continue;
+            }
+            if (WIFSTOPPED(status)) {
+                j->stopped = 1;
+                return;
+            }
+            j->pids[k] = 0;
+            if (k == j->stage_count - 1) {
+                j->status = exit_status(status);
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * Reaps whatever background stages have finished without waiting, and
+ * forgets the jobs that are all done.
+ */
+void job_reap() {
+    int status, i, k;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
+        job_update(pid, status);
+    }
+    for (i = 0; i < MAX_JOBS; i++) {
+        struct job* j = &jobs[i];
+        for (k = 0; j->pgid != 0 && k < j->stage_count && j->pids[k] <= 0; k++);
+        if (j->pgid != 0 && k == j->stage_count) {
+            if (interactive) {
+                printf("[%d] Done     %s\n", i + 1, j->command);
+            }
+            job_free(j);
+        }
+    }
+}
+
+/**
+ * Frees a job's slot.
+ */
+void job_free(struct job* j) {
+    free(j->pids);
+    free(j->command);
+    j->pgid = 0;
+}
+
+/**
+ * 'hash [-r] [command]...': with no arguments, lists the commands whose
+ * paths are known and how many times each was looked up. -r forgets them
+ * all. Commands given are looked up in PATH now.
+ * Return: 1 if a command given couldn't be found. Otherwise 0.
+ */
+int builtin_hash(char** args, int arg_count) {
+    int result = EXIT_SUCCESS, i;
+    if (arg_count == 1) {
+        printf("hits\tcommand\n");
+        for (i = 0; i < PATH_SLOTS; i++) {
+            struct path_entry* e;
+            for (e = path_table[i]; e != NULL; e = e->next) {
+                printf("%4d\t%s\n", e->hits, e->path);
+            }
+        }
+    }
+    for (i = 1; i < arg_count; i++) {
+        if (str_equals(args[i], "-r")) {
+            path_clear();
+        } else if (path_find(args[i]) == NULL) {
+            error("Command not found.");
+            result = EXIT_FAILURE;
+        }
+    }
+    return result;
+}
+
+/**
+ * Finds the file a command runs, the way execvp does: as given if it has a
+ * '/' in it, otherwise the first executable file of that name in one of
+ * PATH's directories. PATH is only searched the first time a command is
+ * looked up. After that its path comes out of path_table, so starting it
+ * costs one exec instead of one failed exec per directory before its own.
+ * Return: The command's path, or NULL if there's none. Only good until
+ *    the next path_clear or path_forget.
+ */
+char* path_find(char* name) {
+    if (strchr(name, '/') != NULL) {
+        return name;
+    }
+    unsigned int slot = hash_name(name) & (PATH_SLOTS - 1);
+    struct path_entry* e;
+    for (e = path_table[slot]; e != NULL; e = e->next) {
+        if (str_equals(e->name, name)) {
+            e->hits++;
+            return e->path;
+        }
+    }
+
+    char* dirs = getenv("PATH");
+    if (dirs == NULL) {
+        dirs = "/bin:/usr/bin"; // what execvp uses without one
+    }
+    size_t name_len = strlen(name);
+    char* path = malloc(strlen(dirs) + name_len + 2);
+    while (1) {
+        char* end = strchr(dirs, ':');
+        size_t dir_len = end != NULL ? (size_t) (end - dirs) : strlen(dirs);
+        if (dir_len == 0) { // an empty directory is the current one
+            memcpy(path, name, name_len + 1);
         } else {
-            if (chdir(args[1])) { // attempt native cd
-                error("cd failed");
+            memcpy(path, dirs, dir_len);
+            path[dir_len] = '/';
+            memcpy(&path[dir_len + 1], name, name_len + 1);
+        }
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0) {
+            break;
+        }
+        if (end == NULL) {
+            free(path);
+            return NULL;
+        }
+        dirs = end + 1;
+    }
+    e = malloc(sizeof (struct path_entry));
+    e->name = strdup(name);
+    e->path = path;
+    e->hits = 1;
+    e->next = path_table[slot];
+    path_table[slot] = e;
+    return path;
+}
+
+/**
+ * Forgets the path of one command, so it's searched for again next time.
+ */
+void path_forget(char* name) {
+    struct path_entry** link = &path_table[hash_name(name) & (PATH_SLOTS - 1)];
+    while (*link != NULL) {
+        struct path_entry* e = *link;
+        if (str_equals(e->name, name)) {
+            *link = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+            return;
+        }
+        link = &e->next;
+    }
+}
+
+/**
+ * Forgets every command's path. Done when PATH changes.
+ */
+void path_clear() {
+    int i;
+    for (i = 0; i < PATH_SLOTS; i++) {
+        while (path_table[i] != NULL) {
+            struct path_entry* e = path_table[i];
+            path_table[i] = e->next;
+            free(e->name);
+            free(e->path);
+            free(e);
+        }
+    }
+}
+
+/**
+ * Splits a line into words, the way a shell does:
+ *    - words are separated by spaces, tabs and carriage returns
+ *    - |, <, > and & are words of their own wherever they are, unless quoted
+ *    - '...' keeps everything in it as it is
+ *    - "..." too, except that \ escapes a " or \ in it
+ *    - \ outside quotes keeps the next character as it is
+ *    - # at the start of a word starts a comment, to the end of the line
+ * The words are copied into t's memory, which is kept from line to line
+ * and only grows when a line is longer than every line before it.
+ * Argument: line - the line, which doesn't have to be NUL terminated
+ * Argument: length - its length, without the newline
+ * Return: -1 - A quote isn't closed
+ * Return: The number of words, put in t->args and NULL terminated
+ */
+int parse_line(struct tokens* t, char* line, size_t length) {
+    // A line of n characters has at most n words, and they take at most
+    // 2n characters with their NULs, so nothing moves once it's started.
+    if (t->chars_size < 2 * length + 1) {
+        t->chars_size = 2 * length + 1 > 2 * t->chars_size ? 2 * length + 1 : 2 * t->chars_size;
+        t->chars = realloc(t->chars, t->chars_size);
+    }
+    if (t->args_size < length + 1) {
+        t->args_size = length + 1 > 2 * t->args_size ? length + 1 : 2 * t->args_size;
+        t->args = realloc(t->args, sizeof (char*) * t->args_size);
+    }
+    char* out = t->chars;
+    int count = 0, in_word = 0;
+    char quote = '\0';
+    size_t i;
+    for (i = 0; i < length; i++) {
+        char c = line[i];
+        if (quote != '\0') {
+            if (c == quote) {
+                quote = '\0';
+            } else if (quote == '"' && c == '\\' && i + 1 < length
+                    && (line[i + 1] == '"' || line[i + 1] == '\\')) {
+                *out++ = line[++i];
+            } else {
+                *out++ = c;
+            }
+            continue;
+        }
+        char* op = c != '\0' ? strchr(OPERATORS, c) : NULL;
+        if (c == ' ' || c == '\t' || c == '\r' || op != NULL) {
+            if (in_word) {
+                *out++ = '\0';
+                in_word = 0;
+            }
+            if (op != NULL) {
+                t->args[count++] = operators[op - OPERATORS];
             }
+            continue;
         }
-    } else {
-        execvp(*args, args);
-        error("Invalid command.");
-        exit(EXIT_FAILURE);
+        if (c == '#' && !in_word) {
+            break; // a comment
+        }
+        if (!in_word) {
+            t->args[count++] = out;
+            in_word = 1;
+        }
+        if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '\\' && i + 1 < length) {
+            *out++ = line[++i];
+        } else {
+            *out++ = c;
+        }
+    }
+    if (quote != '\0') {
+        error("Unterminated quote.");
+        return -1;
+    }
+    if (in_word) {
+        *out = '\0';
+    }
+    t->args[count] = NULL;
+    return count;
+}
+
+/**
+ * Returns 1 if arg is the operator op ("|", "<", ">" or "&") as
+ * parse_line found it, outside quotes. A quoted one is a copy in the
+ * line's words, not one of operators, so it's just a word. Otherwise 0.
+ */
+int is_operator(char* arg, char* op) {
+    return arg >= operators[0] && arg <= operators[OPERATOR_COUNT - 1] && str_equals(arg, op);
+}
+
+/**
+ * Sets up a reader for the lines of a file, or of a string if fd is -1.
+ */
+void reader_init(struct reader* r, int fd, char* text) {
+    r->fd = fd;
+    r->size = text != NULL ? strlen(text) + 1 : READ_BLOCK;
+    r->block = malloc(r->size);
+    r->start = 0;
+    r->end = 0;
+    if (text != NULL) {
+        memcpy(r->block, text, r->size - 1);
+        r->end = r->size - 1;
+    }
+}
+
+/**
+ * Returns the next line of input. Input is read READ_BLOCK bytes at a time
+ * and the lines are handed out of the block, so a script of many short
+ * lines takes one read per block instead of one per line. A line longer
+ * than the block makes it grow.
+ * Argument: length - set to the line's length, without the newline
+ * Return: The line, not NUL terminated, good until the next read_line.
+ *    NULL at the end of the input.
+ */
+char* read_line(struct reader* r, size_t* length) {
+    size_t scanned = 0; // how much of what's left was looked at
+    while (1) {
+        char* line = &r->block[r->start];
+        char* newline = memchr(&line[scanned], '\n', r->end - r->start - scanned);
+        if (newline != NULL) {
+            *length = newline - line;
+            r->start += *length + 1;
+            return line;
+        }
+        scanned = r->end - r->start;
+        ssize_t got = 0;
+        if (r->fd != -1) {
+            // Make room: move what's left to the front, or grow for a long line
+            if (r->start > 0) {
+                memmove(r->block, line, scanned);
+                r->start = 0;
+                r->end = scanned;
+            } else if (r->end == r->size) {
+                r->size *= 2;
+                r->block = realloc(r->block, r->size);
+            }
+            do {
+                got = read(r->fd, &r->block[r->end], r->size - r->end);
+            } while (got == -1 && errno == EINTR);
+        }
+        if (got <= 0) { // the end, maybe with a line that has no newline
+            if (r->start == r->end) {
+                return NULL;
+            }
+            line = &r->block[r->start];
+            *length = r->end - r->start;
+            r->start = r->end;
+            return line;
+        }
+        r->end += got;
+    }
+}
+
+/**
+ * Gives back the input read ahead of the current line, if the reader
+ * reads the shell's stdin and that's a file. A command started next that
+ * reads stdin then gets the rest of the script from the line after its
+ * own, as if the shell read a line at a time. Input from a pipe can't be
+ * given back, so there a command reading stdin misses what was read ahead.
+ */
+void reader_sync(struct reader* r) {
+    if (r->fd == STDIN_FILENO && r->start < r->end
+            && lseek(r->fd, -(off_t) (r->end - r->start), SEEK_CUR) != -1) {
+        r->start = 0;
+        r->end = 0;
     }
-    // The process space is not overridden if local commands
-    // are executed. So the current process will now terminate.
-    exit(EXIT_SUCCESS);
 }
 
 /**
- * Parses the given string into an array of char*. Terminates args with a NULL.
- * Argument: str - string to be parsed into arguments
- * Argument: args - char* array to put arguments into (assuming args has length=MAX_ARGS+1)
- * Return: -1 - The number of arguments exceeds the limit MAX_ARGS
- * Return: The number of arguments retrieved
+ * Turns what waitpid gives into an exit status.
+ * Return: The process' exit status, or 128 + the signal number if a
+ *    signal ended or stopped it
  */
-int parse_line(char *str, char** args) {
-    // Start the argument parsing
-    int argCount = 0;
-    char *n_arg = strtok(str, "\r\n ");
-    while (argCount < MAX_ARGS && n_arg != NULL) {
-        args[argCount++] = n_arg;
-        n_arg = strtok(NULL, "\r\n ");
+int exit_status(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
     }
-    args[argCount] = NULL; // set the last argument to NULL. not out of bounds.
-    if (n_arg == NULL) {
-        return argCount; // success
+    return 128 + WSTOPSIG(status);
+}
+
+/**
+ * Hashes a command name for builtin_table and path_table.
+ * Return: The hash, to be masked down to a slot of either
+ */
+unsigned int hash_name(char* name) {
+    unsigned int h = 0;
+    while (*name != '\0') {
+        h = h * 31 + (unsigned char) *name++;
     }
-    // argCount == MAX_ARGS with n_arg != NULL means #args > MAX_ARGS
-    return -1; // MAX_ARGS exceeded
+    return h ^ (h >> 7);
 }
 
 /**
@@ -294,10 +1287,9 @@ int parse_line(char *str, char** args) {
  * Argument: compare - Second string to compare
  * Return: 0 (false) - if the two strings are not equal.
  * Return: 1 (true) - if the two strings are equal.
- * NOTE: Will compare up to MAX_LEN characters.
  */
 int str_equals(char* arg, char* compare) {
-    return !(strncmp(arg, compare, MAX_LEN));
+    return !(strcmp(arg, compare));
 }
 
 /**
@@ -353,16 +1345,6 @@ void signal_handler(int sig) {
     }
 }
 
-/**
- * Overrides standard output.
- * Will redirect output to the specified file name. If the file name
- * given does not exist it will be created. 
- */
-void redirect_output_name(char* file) {
-    int file_id = open(file, O_CREAT | O_WRONLY | O_TRUNC, 0666);
-    redirect_output_id(file_id);
-}
-
 /**
  * Overrides standard output.
  * Will redirect output to the specified file_id.
@@ -373,15 +1355,6 @@ void redirect_output_id(int file_id) {
     close(file_id);
 }
 
-/**
- * Overrides standard input.
- * Will redirect input to be from the file specified by the given file name.
- */
-void redirect_input_name(char* file) {
-    int file_id = open(file, O_RDONLY, 0666);
-    redirect_input_id(file_id);
-}
-
 /**
  * Overrides standard input.
  * Will redirect input to be from the file specified by the given file id.
@@ -393,16 +1366,40 @@ void redirect_input_id(int file_id) {
 }
 
 /**
- * Iterates through the first arg_count elements of args, comparing each to s.
- * Returns the first index where there is a match.
- * Returns -1 if no match is found.
+ * Joins the first arg_count elements of args with spaces.
+ * Returns the joined string, which the caller has to free.
  */
-int index_of_str(char** args, int arg_count, char* s) {
+char* join_args(char** args, int arg_count) {
+    size_t length = 1;
     int i;
     for (i = 0; i < arg_count; i++) {
-        if (str_equals(args[i], s)) {
-            return i;
+        length += strlen(args[i]) + 1;
+    }
+    char* joined = malloc(length);
+    joined[0] = '\0';
+    for (i = 0; i < arg_count; i++) {
+        strcat(joined, args[i]);
+        if (i < arg_count - 1) {
+            strcat(joined, " ");
         }
     }
-    return -1;
+    return joined;
+}
+
+/**
+ * Builds the arguments that run the script at path with /bin/sh, for a
+ * file without a "#!" line that exec refuses (ENOEXEC), the way execvp
+ * falls back: /bin/sh path args[1] ... args[arg_count-1] NULL.
+ * Returns the new array, which the caller has to free. The strings are
+ * not copied.
+ */
+char** script_args(char* path, char** args, int arg_count) {
+    char** sh_args = malloc(sizeof (char*) * (arg_count + 2));
+    int i;
+    sh_args[0] = "/bin/sh";
+    sh_args[1] = path;
+    for (i = 1; i <= arg_count; i++) {
+        sh_args[i + 1] = args[i];
+    }
+    return sh_args;
 }
@@ -0,0 +1,139 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "accept.h"
+
+static const char *names[] = {"strict", "anneal", "adaptive", "late", "threshold"};
+
+/**
+ * Returns the name of the given kind of policy, as accept_parse reads it.
+ */
+const char *accept_name(enum accept_kind kind) {
+    return names[kind];
+}
+
+/**
+ * Reads a policy: its name, then optionally its parameters after colons.
+ * anneal, adaptive and threshold take the starting T and alpha
+ * (e.g. anneal:50:0.99), late takes the history length (e.g. late:500).
+ * Parameters left out get the defaults.
+ * @return 1 if spec was a valid policy. Otherwise 0.
+ */
+int accept_parse(const char *spec, struct accept_policy *p) {
+    const char *params[2] = {NULL, NULL};
+    const char *colon = strchr(spec, ':');
+    size_t length = colon != NULL ? (size_t) (colon - spec) : strlen(spec);
+    int i, count = 0;
+    while (colon != NULL) {
+        if (count == 2) {
+            return 0; // too many parameters
+        }
+        params[count++] = colon + 1;
+        colon = strchr(colon + 1, ':');
+    }
+    for (i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++) {
+        if (strncmp(names[i], spec, length) == 0 && names[i][length] == '\0') {
+            break;
+        }
+    }
+    if (i == (int) (sizeof(names) / sizeof(names[0]))) {
+        return 0;
+    }
+    p->kind = (enum accept_kind) i;
+    p->t0 = 0;
+    p->alpha = ACCEPT_ALPHA;
+    p->history = ACCEPT_HISTORY;
+    if (p->kind == ACCEPT_STRICT) {
+        return count == 0;
+    }
+    if (p->kind == ACCEPT_LATE) {
+        if (count > 1) {
+            return 0;
+        }
+        if (count == 1) {
+            p->history = atoi(params[0]);
+        }
+        return p->history > 0;
+    }
+    if (count > 0) {
+        p->t0 = atof(params[0]);
+    }
+    if (count > 1) {
+        p->alpha = atof(params[1]);
+    }
+    return p->t0 >= 0 && p->alpha > 0 && p->alpha <= 1;
+}
+
+/**
+ * Sets up a thread's state for the given policy.
+ * @param len Length of the path the thread starts from
+ * @param n Number of nodes, used with len for the automatic starting T
+ */
+void acceptor_init(struct acceptor *a, const struct accept_policy *p, long long len, int n) {
+    int i;
+    a->policy = *p;
+    a->temp = p->t0 > 0 ? p->t0 : (double) len / n;
+    a->cap = a->temp;
+    a->tries = 0;
+    a->window_taken = 0;
+    a->history = NULL;
+    if (p->kind == ACCEPT_LATE) {
+        a->history = (long long *) malloc(p->history * sizeof(long long));
+        for (i = 0; i < p->history; i++) {
+            a->history[i] = len;
+        }
+    }
+}
+
+/**
+ * Deallocates the memory used by a thread's policy state.
+ */
+void acceptor_free(struct acceptor *a) {
+    free(a->history);
+}
+
+/**
+ * Decides whether to take a random swap, and updates the policy's state
+ * for one more swap tried. Swaps that make the path shorter are always
+ * taken. The strict policy doesn't draw random numbers, so runs with it
+ * are the same as before there were policies.
+ * @param len Length of the path before the swap
+ * @param delta How much longer the swap makes it
+ * @return 1 if the swap should be made. Otherwise 0.
+ */
+int acceptor_take(struct acceptor *a, struct rng *rng, long long len, long long delta) {
+    int take = delta < 0;
+    a->tries++;
+    switch (a->policy.kind) {
+        case ACCEPT_STRICT:
+            break;
+        case ACCEPT_ANNEAL:
+        case ACCEPT_ADAPTIVE:
+            if (!take && a->temp > 0) {
+                take = rng_double(rng) < exp(-delta / a->temp);
+                a->window_taken += take;
+            }
+            a->temp *= a->policy.alpha;
+            if (a->policy.kind == ACCEPT_ADAPTIVE) {
+                a->cap *= a->policy.alpha;
+                if (a->tries % ACCEPT_WINDOW == 0) {
+                    // Heat up if too few were taken, cool down if too many
+                    a->temp *= a->window_taken < ACCEPT_TARGET * ACCEPT_WINDOW ? 1.5 : 1 / 1.5;
+                    a->window_taken = 0;
+                }
+                a->temp = a->temp < a->cap ? a->temp : a->cap;
+            }
+            break;
+        case ACCEPT_LATE: {
+            long long *past = &a->history[a->tries % a->policy.history];
+            take |= len + delta <= *past;
+            *past = take ? len + delta : len;
+            break;
+        }
+        case ACCEPT_THRESHOLD:
+            take |= delta < a->temp;
+            a->temp *= a->policy.alpha;
+            break;
+    }
+    return take;
+}
@@ -0,0 +1,55 @@
+/*
+ * Acceptance policies for the random swaps a thread falls back to once no
+ * move type can improve its path. The strict policy only takes swaps that
+ * make the path shorter, so a thread in a local minimum spends its tries
+ * doing nothing. The others sometimes take a swap that makes it longer,
+ * and the move types then climb down from wherever that lands:
+ *    anneal: simulated annealing. A swap that adds delta is taken with
+ *            probability exp(-delta / T), and T is multiplied by alpha
+ *            after every swap tried (geometric cooling).
+ *    adaptive: annealing that every ACCEPT_WINDOW swaps raises or lowers T
+ *              to keep about ACCEPT_TARGET of them taken. T never goes
+ *              above a cap that cools like anneal's T.
+ *    late: late acceptance hill climbing. A swap is taken if the length
+ *          it gives is no more than the length 'history' swaps ago.
+ *    threshold: threshold accepting. A swap is taken if it adds less than
+ *               T, which cools like anneal's.
+ * Every thread keeps its own state, so each can have its own parameters.
+ */
+#ifndef ACCEPT_H
+#define ACCEPT_H
+
+#include "rng.h"
+
+#define ACCEPT_ALPHA 0.999 // default cooling per swap tried
+#define ACCEPT_HISTORY 100 // default late acceptance history length
+#define ACCEPT_WINDOW 100 // swaps between adaptive temperature changes
+#define ACCEPT_TARGET 0.02 // share of swaps adaptive tries to take
+
+enum accept_kind { ACCEPT_STRICT, ACCEPT_ANNEAL, ACCEPT_ADAPTIVE, ACCEPT_LATE, ACCEPT_THRESHOLD };
+
+// A policy as given on the command line, see accept_parse
+struct accept_policy {
+    enum accept_kind kind;
+    double t0; // starting temperature or threshold, 0 for the average edge
+    double alpha; // what T is multiplied by after every swap tried
+    int history; // late acceptance history length
+};
+
+// One thread's state for a policy
+struct acceptor {
+    struct accept_policy policy;
+    double temp; // current temperature or threshold
+    double cap; // adaptive: the highest temp can go
+    long long *history; // late: the lengths of the last swaps, circular
+    long long tries; // swaps tried so far
+    int window_taken; // adaptive: uphill swaps taken in this window
+};
+
+int accept_parse(const char *spec, struct accept_policy *p);
+const char *accept_name(enum accept_kind kind);
+void acceptor_init(struct acceptor *a, const struct accept_policy *p, long long len, int n);
+void acceptor_free(struct acceptor *a);
+int acceptor_take(struct acceptor *a, struct rng *rng, long long len, long long delta);
+
+#endif
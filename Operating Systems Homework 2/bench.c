@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tsp.h"
+#include "rng.h"
+#include "load.h"
+#include "bench.h"
+
+#define BENCH_SEED 20240501 // seed for the instances and the solver
+#define BENCH_SECONDS 5.0 // time limit of each run
+#define BENCH_FILE "cities.txt" // benchmarked too if it can be opened
+#define BENCH_RANGE 50000 // coordinates are in [0, BENCH_RANGE]
+#define BENCH_CLUSTERS 20 // number of clusters in the clustered instances
+#define MAX_NAME 256
+
+// The generated instances
+struct instance {
+    const char *name;
+    int n; // number of nodes
+    int clustered; // 0 for nodes spread evenly over the square
+    const char *metric; // TSPLIB EDGE_WEIGHT_TYPE
+};
+
+static const struct instance instances[] = {
+    {"uniform1000", 1000, 0, "EUC_2D"},
+    {"uniform5000", 5000, 0, "EUC_2D"},
+    {"clustered5000", 5000, 1, "CEIL_2D"},
+};
+
+/**
+ * Opens the given file for writing, exiting if that fails.
+ */
+static FILE *open_output(const char *file) {
+    FILE *f = fopen(file, "w");
+    if (f == NULL) {
+        printf("COULD NOT WRITE '%s'.\n", file);
+        exit(EXIT_FAILURE);
+    }
+    return f;
+}
+
+/**
+ * Returns a random coordinate around center, spread over about a tenth of
+ * the range, kept inside [0, BENCH_RANGE].
+ */
+static int near(struct rng *rng, int center) {
+    int spread = BENCH_RANGE / 10;
+    // The sum of a few uniform draws bunches up around the middle
+    int v = center - spread + (rng_int(rng, spread + 1) + rng_int(rng, spread + 1)
+            + rng_int(rng, spread + 1) + rng_int(rng, spread + 1)) / 2;
+    return v < 0 ? 0 : v > BENCH_RANGE ? BENCH_RANGE : v;
+}
+
+/**
+ * Writes the given instance to file as a TSPLIB file. The same instance is
+ * generated every time.
+ */
+static void write_instance(const struct instance *inst, int number, const char *file) {
+    struct rng rng;
+    rng_seed(&rng, BENCH_SEED, number);
+    int cx[BENCH_CLUSTERS], cy[BENCH_CLUSTERS], i;
+    for (i = 0; i < BENCH_CLUSTERS; i++) {
+        cx[i] = rng_int(&rng, BENCH_RANGE + 1);
+        cy[i] = rng_int(&rng, BENCH_RANGE + 1);
+    }
+
+    FILE *f = open_output(file);
+    fprintf(f, "NAME : %s\n", inst->name);
+    fprintf(f, "TYPE : TSP\n");
+    fprintf(f, "DIMENSION : %d\n", inst->n);
+    fprintf(f, "EDGE_WEIGHT_TYPE : %s\n", inst->metric);
+    fprintf(f, "NODE_COORD_SECTION\n");
+    for (i = 0; i < inst->n; i++) {
+        int x, y;
+        if (inst->clustered) {
+            int c = rng_int(&rng, BENCH_CLUSTERS);
+            x = near(&rng, cx[c]);
+            y = near(&rng, cy[c]);
+        } else {
+            x = rng_int(&rng, BENCH_RANGE + 1);
+            y = rng_int(&rng, BENCH_RANGE + 1);
+        }
+        fprintf(f, "%d %d %d\n", i + 1, x, y);
+    }
+    fprintf(f, "EOF\n");
+    fclose(f);
+}
+
+/**
+ * Loads the nodes of the given file and builds their distances with the
+ * layout and width given by -p, -w and -c, like init_dists in main.c does.
+ * Without a layout flag only this instance switches to DIST_COMPUTED when
+ * it is too big for a matrix.
+ */
+static void load_instance(const char *file) {
+    struct cities cities;
+    load_cities(file, &cities);
+    num_nodes = cities.n;
+    coords = cities.coords;
+    enum dist_layout layout = dist_layout;
+    if (!dist_layout_given && num_nodes > MATRIX_NODE_LIMIT) {
+        layout = DIST_COMPUTED;
+    }
+    dist_matrix_build(&dists, num_nodes, coords, cities.weights, cities.metric, layout,
+            dist_width);
+    free(cities.weights);
+}
+
+/**
+ * Solves the loaded instance at every thread count of the sweep and writes
+ * the results. num_threads is the largest thread count.
+ */
+static void bench_instance(const char *name, FILE *csv, FILE *curve, FILE *json, int *runs) {
+    int max_threads = num_threads, islands = island_count, threads, i;
+    double base_rate = 0; // moves per second with one thread
+    struct run_stats stats = {0};
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        num_threads = threads;
+        island_count = islands < threads ? islands : threads;
+        solve(&stats);
+
+        double rate = stats.moves / stats.seconds;
+        double accept_rate = stats.accepts / stats.seconds;
+        if (threads == 1) {
+            base_rate = rate;
+        }
+        printf("%-14s %7d %7d %8.2f %12.0f %12.0f %8.2f %12lld\n", name, num_nodes,
+               threads, stats.seconds, rate, accept_rate, rate / base_rate, stats.len);
+        fflush(stdout);
+
+        fprintf(csv, "%s,%d,%d,%.3f,%lld,%lld,%.0f,%.0f,%lld\n", name, num_nodes, threads,
+                stats.seconds, stats.moves, stats.accepts, rate, accept_rate, stats.len);
+        for (i = 0; i < stats.samples; i++) {
+            fprintf(curve, "%s,%d,%.3f,%lld\n", name, threads, stats.times[i], stats.lens[i]);
+        }
+
+        fprintf(json, "%s  {\"instance\": \"%s\", \"nodes\": %d, \"threads\": %d, "
+                "\"seconds\": %.3f, \"moves\": %lld, \"accepts\": %lld, "
+                "\"moves_per_sec\": %.0f, \"accepts_per_sec\": %.0f, \"length\": %lld,\n"
+                "   \"curve\": [", *runs > 0 ? ",\n" : "", name, num_nodes, threads,
+                stats.seconds, stats.moves, stats.accepts, rate, accept_rate, stats.len);
+        for (i = 0; i < stats.samples; i++) {
+            fprintf(json, "%s[%.3f, %lld]", i > 0 ? ", " : "", stats.times[i], stats.lens[i]);
+        }
+        fprintf(json, "]}");
+        (*runs)++;
+
+        if (threads > max_threads / 2) {
+            break; // so that threads *= 2 can't overflow
+        }
+    }
+    num_threads = max_threads;
+    island_count = islands;
+    free(stats.times);
+    free(stats.lens);
+}
+
+/**
+ * Runs every benchmark, printing a summary to stdout and writing the
+ * results to files starting with prefix (see bench.h).
+ * Uses the current thread count, island, topology and move settings.
+ */
+void run_benchmarks(const char *prefix) {
+    char file[MAX_NAME];
+    if (strlen(prefix) + 32 > MAX_NAME) {
+        printf("BENCHMARK PREFIX '%s' IS TOO LONG.\n", prefix);
+        exit(EXIT_FAILURE);
+    }
+    sprintf(file, "%s.csv", prefix);
+    FILE *csv = open_output(file);
+    sprintf(file, "%s_curve.csv", prefix);
+    FILE *curve = open_output(file);
+    sprintf(file, "%s.json", prefix);
+    FILE *json = open_output(file);
+    fprintf(csv, "instance,nodes,threads,seconds,moves,accepts,moves_per_sec,"
+            "accepts_per_sec,length\n");
+    fprintf(curve, "instance,threads,seconds,length\n");
+    fprintf(json, "{\"seed\": %d, \"time_limit\": %.1f, \"runs\": [\n",
+            BENCH_SEED, BENCH_SECONDS);
+
+    quiet = 1;
+    seed = BENCH_SEED;
+    time_limit = BENCH_SECONDS;
+    num_tries = 0; // stop on the time limit only
+    printf("%-14s %7s %7s %8s %12s %12s %8s %12s\n", "instance", "nodes", "threads",
+           "seconds", "moves/s", "accepts/s", "speedup", "length");
+
+    int runs = 0, i;
+    FILE *f = fopen(BENCH_FILE, "r");
+    if (f != NULL) {
+        fclose(f);
+        load_instance(BENCH_FILE);
+        bench_instance(BENCH_FILE, csv, curve, json, &runs);
+        free(coords);
+        dist_matrix_free(&dists);
+    }
+    for (i = 0; i < (int) (sizeof(instances) / sizeof(instances[0])); i++) {
+        sprintf(file, "%s_%s.tsp", prefix, instances[i].name);
+        write_instance(&instances[i], i + 1, file);
+        load_instance(file);
+        bench_instance(instances[i].name, csv, curve, json, &runs);
+        free(coords);
+        dist_matrix_free(&dists);
+    }
+
+    fprintf(json, "\n]}\n");
+    fclose(csv);
+    fclose(curve);
+    fclose(json);
+}
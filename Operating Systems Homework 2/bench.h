@@ -0,0 +1,21 @@
+/*
+ * Benchmarks for the solver. A fixed set of instances is solved with fixed
+ * seeds at 1, 2, 4, ... threads (up to -t), each run stopped after
+ * BENCH_SECONDS. For every run the moves tried and accepted per second and
+ * the best length over time (the anytime curve) are recorded, so changes to
+ * the solver can be compared against earlier results and the thread sweep
+ * shows how well it scales.
+ *
+ * Results go to three files:
+ *    prefix.csv: one line per run
+ *    prefix_curve.csv: one line per change of the best length
+ *    prefix.json: both of the above, one object per run
+ * The generated instances are written as TSPLIB files prefix_<name>.tsp and
+ * loaded back through load_cities like any other input.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+void run_benchmarks(const char *prefix);
+
+#endif
@@ -0,0 +1,239 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "best.h"
+
+#define ACTIVE 1 // low bit of an epoch slot: the thread is looking at a snapshot
+
+// One per thread, each on its own cache line so they don't share writes
+struct epoch_slot {
+    _Alignas(64) atomic_ulong epoch; // (epoch << 1) | ACTIVE, or 0 when idle
+};
+
+/**
+ * Allocates a snapshot of the given path.
+ */
+static struct best_tour *new_snapshot(int nodes, int path[], long long len,
+        unsigned long version) {
+    struct best_tour *b = (struct best_tour *) malloc(sizeof(struct best_tour) + nodes * sizeof(int));
+    b->next = NULL;
+    b->version = version;
+    b->len = len;
+    memcpy(b->path, path, nodes * sizeof(int));
+    return b;
+}
+
+/**
+ * Frees a list of snapshots linked through 'next'.
+ */
+static void free_list(struct best_tour *b) {
+    while (b != NULL) {
+        struct best_tour *next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+/**
+ * Publishes the first best path. Must be called before any thread uses
+ * the best path, with the number of threads (slots) that will.
+ */
+void best_init(struct best_shared *b, int n, int path[], long long len, int readers) {
+    b->nodes = n;
+    b->num_slots = readers;
+    b->slots = (struct epoch_slot *) aligned_alloc(64, readers * sizeof(struct epoch_slot));
+    int i;
+    for (i = 0; i < readers; i++) {
+        atomic_init(&b->slots[i].epoch, 0);
+    }
+    atomic_init(&b->epoch, 1);
+    atomic_init(&b->length, len);
+    atomic_init(&b->orphans, NULL);
+    atomic_init(&b->best, new_snapshot(n, path, len, 0));
+}
+
+/**
+ * Frees the best path and everything left to reclaim.
+ * Only call once no thread uses the best path anymore.
+ */
+void best_free(struct best_shared *b) {
+    free_list(atomic_load(&b->orphans));
+    free(atomic_load(&b->best));
+    free(b->slots);
+}
+
+/**
+ * Sets up the state a thread needs to read and publish the best path b.
+ */
+void best_reader_init(struct best_reader *r, struct best_shared *b, int slot) {
+    int i;
+    r->shared = b;
+    r->slot = slot;
+    for (i = 0; i < 3; i++) {
+        r->limbo[i] = NULL;
+        r->limbo_epoch[i] = 0;
+    }
+}
+
+/**
+ * Hands the thread's unreclaimed snapshots over to best_free.
+ */
+void best_reader_free(struct best_reader *r) {
+    int i;
+    for (i = 0; i < 3; i++) {
+        struct best_tour *b = r->limbo[i];
+        while (b != NULL) {
+            struct best_tour *next = b->next;
+            b->next = atomic_load(&r->shared->orphans);
+            while (!atomic_compare_exchange_weak(&r->shared->orphans, &b->next, b));
+            b = next;
+        }
+        r->limbo[i] = NULL;
+    }
+}
+
+/**
+ * Marks the thread as looking at snapshots in the current epoch.
+ */
+static void enter(struct best_reader *r) {
+    unsigned long e = atomic_load(&r->shared->epoch);
+    atomic_store(&r->shared->slots[r->slot].epoch, (e << 1) | ACTIVE);
+}
+
+/**
+ * Marks the thread as done looking at snapshots.
+ */
+static void leave(struct best_reader *r) {
+    atomic_store(&r->shared->slots[r->slot].epoch, 0);
+}
+
+/**
+ * Moves the global epoch forward if every active thread has seen it.
+ */
+static void try_advance(struct best_shared *b) {
+    unsigned long e = atomic_load(&b->epoch);
+    int i;
+    for (i = 0; i < b->num_slots; i++) {
+        unsigned long v = atomic_load(&b->slots[i].epoch);
+        if ((v & ACTIVE) && (v >> 1) != e) {
+            return;
+        }
+    }
+    atomic_compare_exchange_strong(&b->epoch, &e, e + 1);
+}
+
+/**
+ * Frees the replaced snapshots no thread can be looking at anymore, which
+ * is everything replaced two or more epochs ago.
+ */
+static void reclaim(struct best_reader *r) {
+    unsigned long e = atomic_load(&r->shared->epoch);
+    int i;
+    for (i = 0; i < 3; i++) {
+        if (r->limbo[i] != NULL && r->limbo_epoch[i] + 2 <= e) {
+            free_list(r->limbo[i]);
+            r->limbo[i] = NULL;
+        }
+    }
+}
+
+/**
+ * Queues a snapshot that was just replaced to be freed later.
+ */
+static void retire(struct best_reader *r, struct best_tour *b) {
+    unsigned long e = atomic_load(&r->shared->epoch);
+    try_advance(r->shared);
+    reclaim(r);
+    int i = e % 3;
+    if (r->limbo[i] != NULL && r->limbo_epoch[i] != e) {
+        // Left over from 3 epochs ago, so it's safe
+        free_list(r->limbo[i]);
+        r->limbo[i] = NULL;
+    }
+    b->next = r->limbo[i];
+    r->limbo[i] = b;
+    r->limbo_epoch[i] = e;
+}
+
+/**
+ * Returns the length of the best path. Never blocks and never looks at a
+ * snapshot, so it's cheap enough to call on every iteration.
+ */
+long long best_len(struct best_shared *b) {
+    return atomic_load_explicit(&b->length, memory_order_relaxed);
+}
+
+/**
+ * If the best path is shorter than *len, copies it into path and sets *len.
+ * @return 1 if path was overridden. Otherwise 0.
+ */
+int best_copy(struct best_reader *r, int path[], long long *len) {
+    int copied = 0;
+    enter(r);
+    const struct best_tour *b = atomic_load(&r->shared->best);
+    if (b->len < *len) {
+        memcpy(path, b->path, r->shared->nodes * sizeof(int));
+        *len = b->len;
+        copied = 1;
+    }
+    leave(r);
+    return copied;
+}
+
+/**
+ * Makes the given path the best path if it's shorter than the best path.
+ * The path is copied into a new snapshot before any shared state is
+ * touched, so the only shared write is the compare-and-swap.
+ * @return 1 if the path became the best path. Otherwise 0.
+ */
+int best_publish(struct best_reader *r, int path[], long long len) {
+    struct best_shared *shared = r->shared;
+    if (len >= best_len(shared)) {
+        return 0;
+    }
+    struct best_tour *b = new_snapshot(shared->nodes, path, len, 0);
+    enter(r);
+    struct best_tour *old = atomic_load(&shared->best);
+    do {
+        if (old->len <= len) {
+            leave(r);
+            free(b);
+            return 0;
+        }
+        b->version = old->version + 1;
+    } while (!atomic_compare_exchange_weak(&shared->best, &old, b));
+    leave(r);
+
+    // Lower the length hint, unless someone already lowered it further
+    long long hint = atomic_load(&shared->length);
+    while (len < hint && !atomic_compare_exchange_weak(&shared->length, &hint, len));
+
+    retire(r, old);
+    return 1;
+}
+
+/**
+ * Returns the current best path without copying it. The snapshot stays
+ * valid until best_release is called, which should be soon since it holds
+ * back freeing replaced snapshots. Don't publish through the same reader
+ * in between.
+ */
+const struct best_tour *best_acquire(struct best_reader *r) {
+    enter(r);
+    return atomic_load(&r->shared->best);
+}
+
+/**
+ * Releases the snapshot returned by best_acquire.
+ */
+void best_release(struct best_reader *r) {
+    leave(r);
+}
+
+/**
+ * Returns the current best path. Only safe while no thread can replace it,
+ * e.g. after all of them have been joined.
+ */
+const struct best_tour *best_current(struct best_shared *b) {
+    return atomic_load(&b->best);
+}
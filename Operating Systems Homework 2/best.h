@@ -0,0 +1,59 @@
+/*
+ * The best path found so far, shared by a group of threads without a lock.
+ *
+ * The best path is an immutable snapshot that is replaced as a whole: a
+ * thread with a better path copies it into a new snapshot and swings the
+ * shared pointer to it with a compare-and-swap. Readers copy from whatever
+ * snapshot the pointer held when they looked, so nobody ever waits.
+ *
+ * Old snapshots are freed with epoch based reclamation. A thread marks
+ * itself active in the current epoch while it looks at a snapshot, and a
+ * replaced snapshot is only freed once every active thread has moved two
+ * epochs past the one it was replaced in.
+ */
+#ifndef BEST_H
+#define BEST_H
+
+struct best_tour {
+    struct best_tour *next; // next snapshot waiting to be freed
+    unsigned long version; // 0 for the first path, +1 for each replacement
+    long long len; // length of path
+    int path[]; // the nodes in travel order
+};
+
+struct epoch_slot;
+
+// A best path shared by a group of threads
+struct best_shared {
+    int nodes; // number of nodes in a path
+    int num_slots;
+    struct epoch_slot *slots; // one per thread using this best path
+    _Atomic unsigned long epoch;
+    struct best_tour *_Atomic best;
+    // Lowest length published so far. Only ever goes down, so it can be
+    // read without looking at a snapshot.
+    _Atomic long long length;
+    // Snapshots left over by exited threads, freed by best_free
+    struct best_tour *_Atomic orphans;
+};
+
+// Per thread state. Each thread needs its own slot number.
+struct best_reader {
+    struct best_shared *shared;
+    int slot;
+    struct best_tour *limbo[3]; // replaced snapshots, by epoch % 3
+    unsigned long limbo_epoch[3]; // the epoch each list was replaced in
+};
+
+void best_init(struct best_shared *b, int n, int path[], long long len, int readers);
+void best_free(struct best_shared *b);
+void best_reader_init(struct best_reader *r, struct best_shared *b, int slot);
+void best_reader_free(struct best_reader *r);
+long long best_len(struct best_shared *b);
+int best_copy(struct best_reader *r, int path[], long long *len);
+int best_publish(struct best_reader *r, int path[], long long len);
+const struct best_tour *best_acquire(struct best_reader *r);
+void best_release(struct best_reader *r);
+const struct best_tour *best_current(struct best_shared *b);
+
+#endif
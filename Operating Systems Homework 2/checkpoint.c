@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L // for fsync and fileno
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+#define CHECKPOINT_VERSION 1
+
+/**
+ * Writes c to file, replacing it as a whole. If anything fails the old
+ * file is left alone and a warning is printed, since a run shouldn't die
+ * over a missed checkpoint.
+ */
+void checkpoint_write(const char *file, const struct checkpoint *c) {
+    size_t size = strlen(file) + 5;
+    char *temp = (char *) malloc(size);
+    snprintf(temp, size, "%s.tmp", file);
+    FILE *f = fopen(temp, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Could not write checkpoint %s\n", temp);
+        free(temp);
+        return;
+    }
+    fprintf(f, "TSP_CHECKPOINT %d\n", CHECKPOINT_VERSION);
+    fprintf(f, "nodes %d\n", c->n);
+    fprintf(f, "seed %" PRIu64 "\n", c->seed);
+    fprintf(f, "length %lld\n", c->len);
+    fprintf(f, "elapsed %.3f\n", c->elapsed);
+    fprintf(f, "threads %d\n", c->threads);
+    int i;
+    for (i = 0; i < c->threads; i++) {
+        const uint64_t *s = c->rngs[i].s;
+        fprintf(f, "rng %016" PRIx64 " %016" PRIx64 " %016" PRIx64 " %016" PRIx64 "\n",
+                s[0], s[1], s[2], s[3]);
+    }
+    fprintf(f, "path\n");
+    for (i = 0; i < c->n; i++) {
+        fprintf(f, "%d%c", c->path[i], i % 20 == 19 || i == c->n - 1 ? '\n' : ' ');
+    }
+    // Make sure the data is on disk before the rename makes it the checkpoint
+    int failed = fflush(f) != 0 || fsync(fileno(f)) != 0;
+    failed |= fclose(f) != 0;
+    if (failed || rename(temp, file) != 0) {
+        fprintf(stderr, "Could not write checkpoint %s\n", file);
+        remove(temp);
+    }
+    free(temp);
+}
+
+/**
+ * Prints that the checkpoint can't be used and exits.
+ */
+static void invalid(const char *file, const char *why) {
+    printf("CHECKPOINT '%s' IS NOT VALID: %s.\n", file, why);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Reads the checkpoint in file into c, allocating its arrays.
+ * Exits if the file can't be read or isn't a valid checkpoint.
+ */
+void checkpoint_read(const char *file, struct checkpoint *c) {
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        printf("COULD NOT OPEN CHECKPOINT '%s'.\n", file);
+        exit(EXIT_FAILURE);
+    }
+    int version, i;
+    if (fscanf(f, " TSP_CHECKPOINT %d", &version) != 1 || version != CHECKPOINT_VERSION) {
+        invalid(file, "unknown format");
+    }
+    if (fscanf(f, " nodes %d seed %" SCNu64 " length %lld elapsed %lf threads %d", &c->n,
+            &c->seed, &c->len, &c->elapsed, &c->threads) != 5 || c->n < 1 || c->threads < 0) {
+        invalid(file, "bad header");
+    }
+    c->rngs = (struct rng *) malloc((c->threads > 0 ? c->threads : 1) * sizeof(struct rng));
+    c->path = (int *) malloc(c->n * sizeof(int));
+    for (i = 0; i < c->threads; i++) {
+        uint64_t *s = c->rngs[i].s;
+        if (fscanf(f, " rng %" SCNx64 " %" SCNx64 " %" SCNx64 " %" SCNx64,
+                &s[0], &s[1], &s[2], &s[3]) != 4) {
+            invalid(file, "bad generator state");
+        }
+    }
+    char word[8];
+    if (fscanf(f, " %7s", word) != 1 || strcmp(word, "path") != 0) {
+        invalid(file, "no path");
+    }
+    char *seen = (char *) calloc(c->n, sizeof(char));
+    for (i = 0; i < c->n; i++) {
+        if (fscanf(f, "%d", &c->path[i]) != 1 || c->path[i] < 0 || c->path[i] >= c->n
+                || seen[c->path[i]]) {
+            invalid(file, "the path doesn't visit every node once");
+        }
+        seen[c->path[i]] = 1;
+    }
+    free(seen);
+    fclose(f);
+}
+
+/**
+ * Deallocates the arrays of c.
+ */
+void checkpoint_free(struct checkpoint *c) {
+    free(c->rngs);
+    free(c->path);
+}
@@ -0,0 +1,37 @@
+/*
+ * Checkpoints of a run, so a killed run can be picked up again: the best
+ * path, the master seed and every thread's random number generator.
+ * The file is plain text:
+ *    TSP_CHECKPOINT 1
+ *    nodes <n>
+ *    seed <master seed>
+ *    length <length of the path>
+ *    elapsed <seconds searched so far, over every run>
+ *    threads <count>
+ *    rng <4 hex words>          (one line per thread)
+ *    path
+ *    <n node numbers>
+ * It is written to a temporary file that is then renamed over the old
+ * one, so a kill in the middle never leaves a broken checkpoint.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include "rng.h"
+
+struct checkpoint {
+    int n; // number of nodes
+    uint64_t seed;
+    long long len; // length of path
+    double elapsed;
+    int threads; // number of generators in rngs
+    struct rng *rngs;
+    int *path;
+};
+
+void checkpoint_write(const char *file, const struct checkpoint *c);
+void checkpoint_read(const char *file, struct checkpoint *c);
+void checkpoint_free(struct checkpoint *c);
+
+#endif
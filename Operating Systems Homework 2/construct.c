@@ -0,0 +1,384 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tsp.h"
+#include "grid.h"
+#include "neighbors.h"
+#include "construct.h"
+
+#define NODES_PER_CELL 2
+#define HILBERT_ORDER 16 // the curve covers a 2^16 x 2^16 grid
+
+static void random_build(int path[], struct rng *rng);
+static void nn_build(int path[], struct rng *rng);
+static void greedy_build(int path[], struct rng *rng);
+static void hilbert_build(int path[], struct rng *rng);
+
+const struct builder builders[] = {
+    {"random", random_build},
+    {"nn", nn_build},
+    {"greedy", greedy_build},
+    {"hilbert", hilbert_build},
+};
+const int num_builders = sizeof(builders) / sizeof(builders[0]);
+
+/**
+ * Returns the builder with the given name, or NULL if there is none.
+ */
+const struct builder *find_builder(const char *name) {
+    int i;
+    for (i = 0; i < num_builders; i++) {
+        if (strcmp(builders[i].name, name) == 0) {
+            return &builders[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Random path: starts in order and switches every index with a random one
+ * at or before it.
+ */
+static void random_build(int path[], struct rng *rng) {
+    int i;
+    for (i = 0; i < num_nodes; i++) {
+        path[i] = i;
+    }
+    for (i = num_nodes - 1; i > 0; i--) {
+        int j = rng_int(rng, i + 1);
+        int temp = path[i];
+        path[i] = path[j];
+        path[j] = temp;
+    }
+}
+
+// Grid of the nodes that can still be picked. The nodes still in cell c
+// are g.nodes[g.start[c]] .. g.nodes[g.start[c] + left[c] - 1].
+struct pool {
+    struct grid g;
+    int *left; // number of nodes still in each cell
+    int *where; // index of each node in g.nodes
+    char *in; // in[node] := 1 if node can still be picked
+};
+
+/**
+ * Puts every node in the pool.
+ */
+static void pool_init(struct pool *p) {
+    grid_build(&p->g, num_nodes, coords, NODES_PER_CELL);
+    int cells = p->g.nx * p->g.ny, c, i;
+    p->left = (int *) malloc(cells * sizeof(int));
+    p->where = (int *) malloc(num_nodes * sizeof(int));
+    p->in = (char *) malloc(num_nodes * sizeof(char));
+    for (c = 0; c < cells; c++) {
+        p->left[c] = p->g.start[c + 1] - p->g.start[c];
+        for (i = p->g.start[c]; i < p->g.start[c + 1]; i++) {
+            p->where[p->g.nodes[i]] = i;
+        }
+    }
+    memset(p->in, 1, num_nodes);
+}
+
+/**
+ * Deallocates the pool.
+ */
+static void pool_free(struct pool *p) {
+    grid_free(&p->g);
+    free(p->left);
+    free(p->where);
+    free(p->in);
+}
+
+/**
+ * Takes node out of the pool by moving the last node of its cell into its
+ * place.
+ */
+static void pool_remove(struct pool *p, int node) {
+    if (!p->in[node]) {
+        return;
+    }
+    struct grid *g = &p->g;
+    int c = grid_row(g, coords[2*node+1]) * g->nx + grid_col(g, coords[2*node]);
+    int last = g->start[c] + --p->left[c];
+    int other = g->nodes[last];
+    g->nodes[p->where[node]] = other;
+    p->where[other] = p->where[node];
+    g->nodes[last] = node;
+    p->where[node] = last;
+    p->in[node] = 0;
+}
+
+/**
+ * Returns the squared distance between nodes a and b.
+ */
+static double square_dist(int a, int b) {
+    double dx = coords[2*a] - coords[2*b];
+    double dy = coords[2*a+1] - coords[2*b+1];
+    return dx*dx + dy*dy;
+}
+
+/**
+ * Returns the node in the pool closest to node i, or -1 if it's empty.
+ * The candidate neighbor list is checked first, since the closest node
+ * is usually on it. Otherwise the cells are searched in rings around i's
+ * cell like in neighbors.c.
+ */
+static int pool_closest(struct pool *p, int i) {
+    int k;
+    for (k = 0; k < num_neighbors; k++) {
+        int j = neighbors[(size_t)i * num_neighbors + k];
+        if (p->in[j]) {
+            return j; // the lists are sorted, so nothing closer is left
+        }
+    }
+    const struct grid *g = &p->g;
+    int col = grid_col(g, coords[2*i]), row = grid_row(g, coords[2*i+1]);
+    int max_ring = g->nx > g->ny ? g->nx : g->ny;
+    int best = -1, r, x, y, c;
+    double best_d = 0;
+    for (r = 0; r <= max_ring; r++) {
+        for (y = row - r; y <= row + r; y++) {
+            if (y < 0 || y >= g->ny) {
+                continue;
+            }
+            int step = (y == row - r || y == row + r) ? 1 : 2 * r;
+            for (x = col - r; x <= col + r; x += step > 0 ? step : 1) {
+                if (x < 0 || x >= g->nx) {
+                    continue;
+                }
+                int cell = y * g->nx + x;
+                for (c = g->start[cell]; c < g->start[cell] + p->left[cell]; c++) {
+                    int j = g->nodes[c];
+                    double d = square_dist(i, j);
+                    if (best == -1 || d < best_d || (d == best_d && j < best)) {
+                        best = j;
+                        best_d = d;
+                    }
+                }
+            }
+        }
+        double reach = r * g->size;
+        if (best != -1 && best_d < reach * reach) {
+            break;
+        }
+    }
+    return best;
+}
+
+/**
+ * Nearest neighbor path from a random start.
+ */
+static void nn_build(int path[], struct rng *rng) {
+    struct pool p;
+    pool_init(&p);
+    int node = rng_int(rng, num_nodes), i;
+    for (i = 0; i < num_nodes; i++) {
+        path[i] = node;
+        pool_remove(&p, node);
+        if (i + 1 < num_nodes) {
+            node = pool_closest(&p, node);
+        }
+    }
+    pool_free(&p);
+}
+
+// A candidate edge for the greedy builder
+struct edge {
+    long long len;
+    int a, b;
+};
+
+/**
+ * Orders edges from shortest to longest, then by their nodes so the
+ * order never depends on qsort.
+ */
+static int compare_edges(const void *x, const void *y) {
+    const struct edge *e = (const struct edge *) x, *f = (const struct edge *) y;
+    if (e->len != f->len) {
+        return e->len < f->len ? -1 : 1;
+    }
+    if (e->a != f->a) {
+        return e->a < f->a ? -1 : 1;
+    }
+    return (e->b > f->b) - (e->b < f->b);
+}
+
+/**
+ * Returns the representative of node's piece, shortening the chain on the
+ * way (union-find).
+ */
+static int find_piece(int piece[], int node) {
+    while (piece[node] != node) {
+        piece[node] = piece[piece[node]];
+        node = piece[node];
+    }
+    return node;
+}
+
+/**
+ * Returns 1 if x is one of the k values in list. Otherwise 0.
+ */
+static int in_list(const int list[], int k, int x) {
+    int i;
+    for (i = 0; i < k; i++) {
+        if (list[i] == x) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Greedy edge path. Only the candidate edges are considered, shortest
+ * first, and one is added if neither end already has two edges and it
+ * doesn't close a loop. That leaves pieces of path, which are joined by
+ * walking along them and going from the end of each to the closest end of
+ * another, starting at a random one.
+ */
+static void greedy_build(int path[], struct rng *rng) {
+    int n = num_nodes, k = num_neighbors, i, j, count = 0;
+    struct edge *edges = (struct edge *) malloc(((size_t)n * k + 1) * sizeof(struct edge));
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < k; j++) {
+            int b = neighbors[(size_t)i * k + j];
+            // Each edge once, even if only one end has it in its list
+            if (i < b || !in_list(&neighbors[(size_t)b * k], k, i)) {
+                edges[count].len = dist(i, b);
+                edges[count].a = i < b ? i : b;
+                edges[count].b = i < b ? b : i;
+                count++;
+            }
+        }
+    }
+    qsort(edges, count, sizeof(struct edge), compare_edges);
+
+    // adj[2*node], adj[2*node+1] := the nodes joined to node, or -1
+    int *adj = (int *) malloc(2 * (size_t)n * sizeof(int));
+    int *piece = (int *) malloc(n * sizeof(int));
+    for (i = 0; i < n; i++) {
+        adj[2*i] = adj[2*i+1] = -1;
+        piece[i] = i;
+    }
+    for (i = 0; i < count; i++) {
+        int a = edges[i].a, b = edges[i].b;
+        if (adj[2*a+1] != -1 || adj[2*b+1] != -1) {
+            continue;
+        }
+        int pa = find_piece(piece, a), pb = find_piece(piece, b);
+        if (pa == pb) {
+            continue;
+        }
+        piece[pa] = pb;
+        adj[2*a + (adj[2*a] != -1)] = b;
+        adj[2*b + (adj[2*b] != -1)] = a;
+    }
+    free(edges);
+    free(piece);
+
+    // Only the ends of the pieces can be joined to, so the pool only
+    // holds those
+    struct pool p;
+    pool_init(&p);
+    for (i = 0; i < n; i++) {
+        if (adj[2*i+1] != -1) {
+            pool_remove(&p, i);
+        }
+    }
+    int node = pool_closest(&p, rng_int(rng, n)), prev, next;
+    for (i = 0; i < n;) {
+        // Walk the piece that starts at node
+        pool_remove(&p, node);
+        prev = -1;
+        while (1) {
+            path[i++] = node;
+            next = adj[2*node] != prev ? adj[2*node] : adj[2*node+1];
+            if (next == -1 || next == prev) {
+                break;
+            }
+            prev = node;
+            node = next;
+        }
+        pool_remove(&p, node); // the other end
+        if (i < n) {
+            node = pool_closest(&p, node);
+        }
+    }
+    pool_free(&p);
+    free(adj);
+}
+
+/**
+ * Returns the position of the point (x, y) along the Hilbert curve
+ * through a 2^order x 2^order grid.
+ */
+static uint64_t hilbert_index(uint32_t x, uint32_t y, int order) {
+    uint64_t d = 0;
+    uint32_t s;
+    for (s = 1u << (order - 1); s > 0; s >>= 1) {
+        uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+        d += (uint64_t) s * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant so the curve inside it lines up
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            uint32_t temp = x;
+            x = y;
+            y = temp;
+        }
+        x &= s - 1;
+        y &= s - 1;
+    }
+    return d;
+}
+
+// A node and its position on the curve
+struct curve_point {
+    uint64_t index;
+    int node;
+};
+
+/**
+ * Orders points along the curve, then by node.
+ */
+static int compare_points(const void *x, const void *y) {
+    const struct curve_point *p = (const struct curve_point *) x, *q = (const struct curve_point *) y;
+    if (p->index != q->index) {
+        return p->index < q->index ? -1 : 1;
+    }
+    return (p->node > q->node) - (p->node < q->node);
+}
+
+/**
+ * Hilbert curve path: the nodes are scaled onto the curve's grid and
+ * visited in the order the curve passes them. The curve goes through
+ * every cell of a block before leaving it, so close nodes mostly end up
+ * close on the path.
+ * rng picks which node the path starts at, which doesn't change its length.
+ */
+static void hilbert_build(int path[], struct rng *rng) {
+    int n = num_nodes, i;
+    double minx = coords[0], maxx = coords[0], miny = coords[1], maxy = coords[1];
+    for (i = 1; i < n; i++) {
+        if (coords[2*i] < minx) minx = coords[2*i];
+        if (coords[2*i] > maxx) maxx = coords[2*i];
+        if (coords[2*i+1] < miny) miny = coords[2*i+1];
+        if (coords[2*i+1] > maxy) maxy = coords[2*i+1];
+    }
+    double side = maxx - minx > maxy - miny ? maxx - minx : maxy - miny;
+    double scale = side > 0 ? ((1u << HILBERT_ORDER) - 1) / side : 0;
+    struct curve_point *points = (struct curve_point *) malloc(n * sizeof(struct curve_point));
+    for (i = 0; i < n; i++) {
+        uint32_t x = (uint32_t) ((coords[2*i] - minx) * scale);
+        uint32_t y = (uint32_t) ((coords[2*i+1] - miny) * scale);
+        points[i].index = hilbert_index(x, y, HILBERT_ORDER);
+        points[i].node = i;
+    }
+    qsort(points, n, sizeof(struct curve_point), compare_points);
+    int start = rng_int(rng, n);
+    for (i = 0; i < n; i++) {
+        path[i] = points[(start + i) % n].node;
+    }
+    free(points);
+}
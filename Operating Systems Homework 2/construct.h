@@ -0,0 +1,30 @@
+/*
+ * Builders for the path the hill climbing starts from:
+ *    random: every order equally likely (Fisher-Yates shuffle)
+ *    nn: nearest neighbor, always going to the closest node not visited yet
+ *    greedy: greedy edge, adding the shortest edges that keep a valid path
+ *            and joining the pieces left over by nearest neighbor
+ *    hilbert: the order the nodes come in along a Hilbert curve
+ * Everything but random takes about O(n log n) or O(n k) time for evenly
+ * spread nodes, using the grid and the candidate neighbor lists, which
+ * must already be built.
+ */
+#ifndef CONSTRUCT_H
+#define CONSTRUCT_H
+
+#include "rng.h"
+
+struct builder {
+    const char *name;
+    /*
+     * Fills path with a round trip through all num_nodes nodes. rng picks
+     * the start or the order, so different generators give different paths.
+     */
+    void (*build)(int path[], struct rng *rng);
+};
+
+extern const struct builder builders[];
+extern const int num_builders;
+const struct builder *find_builder(const char *name);
+
+#endif
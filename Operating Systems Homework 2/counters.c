@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "counters.h"
+
+struct counters *counters;
+int num_counters;
+
+// Totals and time at the last live report, to print rates since then
+static struct counter_totals last;
+static double last_seconds;
+
+/**
+ * Allocates zeroed counters for the given number of threads.
+ */
+void counters_init(int threads) {
+    num_counters = threads;
+    counters = (struct counters *) aligned_alloc(64, threads * sizeof(struct counters));
+    int i;
+    for (i = 0; i < threads; i++) {
+        atomic_init(&counters[i].moves, 0);
+        atomic_init(&counters[i].accepts, 0);
+        atomic_init(&counters[i].swaps, 0);
+        atomic_init(&counters[i].copies, 0);
+        atomic_init(&counters[i].publishes, 0);
+        atomic_init(&counters[i].sync_ns, 0);
+    }
+    last = (struct counter_totals) {0};
+    last_seconds = 0;
+}
+
+/**
+ * Deallocates the counters.
+ */
+void counters_free() {
+    free(counters);
+    counters = NULL;
+}
+
+/**
+ * Returns a monotonic time in nanoseconds, for timing short sections.
+ */
+long long counters_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Reads the counters of the given thread. Safe while it's running, though
+ * the values may be from slightly different moments.
+ */
+void counters_read(int thread, struct counter_totals *t) {
+    struct counters *c = &counters[thread];
+    t->moves = atomic_load_explicit(&c->moves, memory_order_relaxed);
+    t->accepts = atomic_load_explicit(&c->accepts, memory_order_relaxed);
+    t->swaps = atomic_load_explicit(&c->swaps, memory_order_relaxed);
+    t->copies = atomic_load_explicit(&c->copies, memory_order_relaxed);
+    t->publishes = atomic_load_explicit(&c->publishes, memory_order_relaxed);
+    t->sync_ns = atomic_load_explicit(&c->sync_ns, memory_order_relaxed);
+}
+
+/**
+ * Adds up the counters of every thread.
+ */
+void counters_sum(struct counter_totals *t) {
+    *t = (struct counter_totals) {0};
+    int i;
+    for (i = 0; i < num_counters; i++) {
+        struct counter_totals c;
+        counters_read(i, &c);
+        t->moves += c.moves;
+        t->accepts += c.accepts;
+        t->swaps += c.swaps;
+        t->copies += c.copies;
+        t->publishes += c.publishes;
+        t->sync_ns += c.sync_ns;
+    }
+}
+
+/**
+ * Prints the rates of all threads together since the last report to
+ * stderr, along with the current best length.
+ * @param seconds Time since the threads started
+ */
+void counters_report(double seconds, long long len) {
+    struct counter_totals now;
+    counters_sum(&now);
+    double span = seconds - last_seconds;
+    if (span <= 0) {
+        return;
+    }
+    // Share of the threads' time spent on the shared best paths
+    double sync = (now.sync_ns - last.sync_ns) / (span * 1e9 * num_counters);
+    fprintf(stderr, "[%7.2fs] moves %.0f/s, accepts %.0f/s, swaps %.0f/s, "
+            "copies %.0f/s, publishes %.0f/s, sync %.2f%%, best %lld\n", seconds,
+            (now.moves - last.moves) / span, (now.accepts - last.accepts) / span,
+            (now.swaps - last.swaps) / span, (now.copies - last.copies) / span,
+            (now.publishes - last.publishes) / span, 100 * sync, len);
+    last = now;
+    last_seconds = seconds;
+}
+
+/**
+ * Prints every thread's counters and the totals to stderr. Meant for the
+ * end of a run.
+ * @param seconds How long the threads ran
+ */
+void counters_summary(double seconds) {
+    fprintf(stderr, "%6s %12s %12s %12s %8s %9s %10s\n", "thread", "moves",
+            "accepts", "swaps", "copies", "publishes", "sync ms");
+    int i;
+    for (i = 0; i < num_counters; i++) {
+        struct counter_totals c;
+        counters_read(i, &c);
+        fprintf(stderr, "%6d %12lld %12lld %12lld %8lld %9lld %10.3f\n", i, c.moves,
+                c.accepts, c.swaps, c.copies, c.publishes, c.sync_ns / 1e6);
+    }
+    struct counter_totals t;
+    counters_sum(&t);
+    fprintf(stderr, "%6s %12lld %12lld %12lld %8lld %9lld %10.3f\n", "total", t.moves,
+            t.accepts, t.swaps, t.copies, t.publishes, t.sync_ns / 1e6);
+    if (seconds > 0) {
+        fprintf(stderr, "%.0f moves/s, %.0f accepts/s over %.2fs\n", t.moves / seconds,
+                t.accepts / seconds, seconds);
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * Counters for what the hill climbing threads are doing. Every thread
+ * owns one set, on its own cache lines, and is the only one writing it,
+ * so counting is a plain load and store. Other threads can read them at
+ * any time to report rates while the threads run.
+ *
+ * Best paths are shared without a lock (see best.h), so instead of lock
+ * wait time the counters keep the time spent copying the best path in and
+ * publishing a better one, which is where threads touch shared state.
+ */
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdatomic.h>
+
+struct counters {
+    _Alignas(64) atomic_llong moves; // move type calls and random swaps tried
+    atomic_llong accepts; // moves that made the path shorter
+    atomic_llong swaps; // random swaps tried once the move types ran out
+    atomic_llong copies; // times the island's best path was copied in
+    atomic_llong publishes; // times the thread's path became the island's best
+    atomic_llong sync_ns; // nanoseconds spent copying and publishing
+};
+
+// A snapshot of some counters added up
+struct counter_totals {
+    long long moves, accepts, swaps, copies, publishes, sync_ns;
+};
+
+extern struct counters *counters; // counters[t] := thread t's counters
+extern int num_counters;
+
+/**
+ * Adds v to a counter. Only the owning thread may call this.
+ */
+static inline void counter_add(atomic_llong *c, long long v) {
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + v,
+                          memory_order_relaxed);
+}
+
+void counters_init(int threads);
+void counters_free();
+long long counters_now_ns();
+void counters_read(int thread, struct counter_totals *t);
+void counters_sum(struct counter_totals *t);
+void counters_report(double seconds, long long len);
+void counters_summary(double seconds);
+
+#endif
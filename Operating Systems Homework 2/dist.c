@@ -0,0 +1,347 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dist.h"
+#include "simd.h"
+#include "shared.h"
+
+#define DIST_BLOCK 64 // nodes per side of the blocks the matrix is built in
+
+/**
+ * Picks the smallest entry width that can hold the longest possible
+ * distance between the given nodes. That's the diagonal of the box
+ * around all of them (its width plus height for MAN_2D, plus one for
+ * rounding up), half way around the earth for GEO, or the largest weight
+ * for EXPLICIT. Float is only picked for EXPLICIT weights that aren't
+ * whole numbers: for longer whole distances its 24 bit mantissa would
+ * round them off.
+ * @return The width, or DIST_AUTO if the distances can be longer than
+ *    UINT32_MAX, so no width holds them exactly
+ */
+enum dist_width dist_width_for(int n, double coords[], const double weights[],
+        enum dist_metric metric) {
+    double longest = 0;
+    size_t k;
+    if (n == 0 || metric == METRIC_GEO) {
+        return DIST_U16;
+    }
+    if (metric == METRIC_EXPLICIT) {
+        for (k = 0; k < (size_t) n * n; k++) {
+            if (weights[k] > longest) longest = weights[k];
+            if (weights[k] < 0 || weights[k] != floor(weights[k])) {
+                return DIST_FLOAT;
+            }
+        }
+        return longest <= UINT16_MAX ? DIST_U16 : longest <= UINT32_MAX ? DIST_U32 : DIST_AUTO;
+    }
+    double minx = coords[0], maxx = coords[0], miny = coords[1], maxy = coords[1];
+    int i;
+    for (i = 1; i < n; i++) {
+        if (coords[2*i] < minx) minx = coords[2*i];
+        if (coords[2*i] > maxx) maxx = coords[2*i];
+        if (coords[2*i+1] < miny) miny = coords[2*i+1];
+        if (coords[2*i+1] > maxy) maxy = coords[2*i+1];
+    }
+    double w = maxx - minx, h = maxy - miny;
+    longest = (metric == METRIC_MAN_2D ? w + h : sqrt(w*w + h*h)) + 1;
+    if (longest <= UINT16_MAX) {
+        return DIST_U16;
+    }
+    if (longest <= UINT32_MAX) {
+        return DIST_U32;
+    }
+    return DIST_AUTO;
+}
+
+/**
+ * Returns a printable name for the given width.
+ */
+const char *dist_width_name(enum dist_width width) {
+    switch (width) {
+        case DIST_U16:
+            return "16 bit";
+        case DIST_U32:
+            return "32 bit";
+        case DIST_FLOAT:
+            return "float";
+        default:
+            return "auto";
+    }
+}
+
+/**
+ * Returns a printable name for the given layout.
+ */
+const char *dist_layout_name(enum dist_layout layout) {
+    switch (layout) {
+        case DIST_PACKED:
+            return "packed";
+        case DIST_COMPUTED:
+            return "computed";
+        default:
+            return "full";
+    }
+}
+
+/**
+ * Returns a printable name for the given metric.
+ */
+const char *dist_metric_name(enum dist_metric metric) {
+    switch (metric) {
+        case METRIC_EUC_2D:
+            return "EUC_2D";
+        case METRIC_CEIL_2D:
+            return "CEIL_2D";
+        case METRIC_ATT:
+            return "ATT";
+        case METRIC_GEO:
+            return "GEO";
+        case METRIC_MAN_2D:
+            return "MAN_2D";
+        case METRIC_EXPLICIT:
+            return "EXPLICIT";
+        default:
+            return "truncated Euclidean";
+    }
+}
+
+/**
+ * Writes the distances from node i to nodes j0..j1-1 into m, and into
+ * their mirrored entries if the layout is full.
+ */
+static void store_row(struct dist_matrix *m, int i, int j0, int j1, const double d[]) {
+    size_t a = m->row[i];
+    int j, mirror = m->layout == DIST_FULL;
+    switch (m->width) {
+        case DIST_U16: {
+            uint16_t *data = (uint16_t *) m->data;
+            for (j = j0; j < j1; j++) {
+                data[a + j] = (uint16_t) d[j - j0];
+                if (mirror) data[m->row[j] + i] = (uint16_t) d[j - j0];
+            }
+            break;
+        }
+        case DIST_U32: {
+            uint32_t *data = (uint32_t *) m->data;
+            for (j = j0; j < j1; j++) {
+                data[a + j] = (uint32_t) d[j - j0];
+                if (mirror) data[m->row[j] + i] = (uint32_t) d[j - j0];
+            }
+            break;
+        }
+        default: {
+            float *data = (float *) m->data;
+            for (j = j0; j < j1; j++) {
+                data[a + j] = (float) d[j - j0];
+                if (mirror) data[m->row[j] + i] = (float) d[j - j0];
+            }
+        }
+    }
+}
+
+/**
+ * Builds m like dist_matrix_build does, with the entries in memory shared
+ * with processes forked afterwards if shared is set.
+ */
+static void build(struct dist_matrix *m, int n, double coords[], const double weights[],
+        enum dist_metric metric, enum dist_layout layout, enum dist_width width, int shared) {
+    size_t size, entries;
+    int i, bi, bj;
+
+    m->coords = coords;
+    m->metric = metric;
+    m->shared = shared;
+    enum dist_width needed = DIST_U16;
+    if (layout != DIST_COMPUTED) {
+        needed = dist_width_for(n, coords, weights, metric);
+        if (needed == DIST_AUTO && metric == METRIC_EXPLICIT) {
+            printf("EXPLICIT DISTANCES ARE TOO LONG TO STORE.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (needed == DIST_AUTO) {
+            // Any entry would round them off, so don't store them at all
+            fprintf(stderr, "Distances too long to store, computing them instead\n");
+            layout = DIST_COMPUTED;
+        }
+    }
+    if (layout == DIST_COMPUTED && metric == METRIC_EXPLICIT) {
+        printf("EXPLICIT DISTANCES CAN'T BE COMPUTED.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (layout == DIST_COMPUTED) {
+        m->n = n;
+        m->layout = layout;
+        m->width = DIST_AUTO;
+        m->data = NULL;
+        m->row = NULL;
+        m->bytes = 0;
+        return;
+    }
+
+    if (width == DIST_AUTO) {
+        width = needed;
+    } else if (width < needed) {
+        printf("DISTANCES DON'T FIT IN %s ENTRIES.\n", dist_width_name(width));
+        exit(EXIT_FAILURE);
+    }
+    m->n = n;
+    m->layout = layout;
+    m->width = width;
+    size = width == DIST_U16 ? sizeof(uint16_t) : width == DIST_U32 ? sizeof(uint32_t) : sizeof(float);
+
+    // Where every row starts. In the packed layout row a only holds
+    // columns a..n-1, so it is shifted back by a to allow indexing by b.
+    m->row = (size_t *) malloc((n > 0 ? n : 1) * sizeof(size_t));
+    for (i = 0; i < n; i++) {
+        if (layout == DIST_PACKED) {
+            m->row[i] = (size_t) i * (2 * (size_t) n - i + 1) / 2 - i;
+        } else {
+            m->row[i] = (size_t) i * n;
+        }
+    }
+    entries = layout == DIST_PACKED ? (size_t) n * (n + 1) / 2 : (size_t) n * n;
+    m->bytes = entries * size;
+    // The padding lets simd_path_len read 16 bit entries 32 bits at a time
+    if (shared) {
+        m->data = shared_alloc(m->bytes + sizeof(uint32_t));
+    } else {
+        m->data = malloc(m->bytes + sizeof(uint32_t));
+    }
+    // The coordinates as separate x and y arrays for the vector kernels
+    double *xs = (double *) malloc((n > 0 ? n : 1) * sizeof(double));
+    double *ys = (double *) malloc((n > 0 ? n : 1) * sizeof(double));
+    if (m->row == NULL || m->data == NULL || xs == NULL || ys == NULL) {
+        printf("NOT ENOUGH MEMORY FOR %zu BYTES OF DISTANCES.\n", m->bytes);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++) {
+        xs[i] = coords[2*i];
+        ys[i] = coords[2*i+1];
+    }
+
+    // Go through the upper triangle in square blocks, so that the mirrored
+    // writes of a full matrix stay within a few cache lines per row
+    enum simd_level level = simd_level();
+    double d[DIST_BLOCK];
+    for (bi = 0; bi < n; bi += DIST_BLOCK) {
+        int iend = bi + DIST_BLOCK < n ? bi + DIST_BLOCK : n;
+        for (bj = bi; bj < n; bj += DIST_BLOCK) {
+            int jend = bj + DIST_BLOCK < n ? bj + DIST_BLOCK : n;
+            for (i = bi; i < iend; i++) {
+                int j0 = i > bj ? i : bj;
+                if (j0 >= jend) {
+                    continue;
+                }
+                if (metric == METRIC_EXPLICIT) {
+                    memcpy(d, &weights[(size_t) i * n + j0], (jend - j0) * sizeof(double));
+                } else {
+                    simd_dist_row(level, metric, coords, xs, ys, i, j0, jend, d);
+                }
+                if (j0 == i) {
+                    d[0] = 0; // GEO doesn't give 0 for a node to itself
+                }
+                store_row(m, i, j0, jend, d);
+            }
+        }
+    }
+    free(xs);
+    free(ys);
+}
+
+/**
+ * Allocates m and fills it with the distances between all of the n nodes
+ * in coords. Each distance is only computed once and mirrored if the
+ * layout is full. DIST_AUTO picks the width with dist_width_for.
+ * For EXPLICIT the distances are taken from weights instead, n*n of them
+ * row by row, of which only the upper triangle is read; otherwise weights
+ * can be NULL.
+ * The computed layout stores nothing and keeps a pointer to coords instead,
+ * so coords must stay allocated for as long as m is used.
+ * Distances longer than UINT32_MAX are computed instead of stored, since
+ * no width holds them exactly.
+ * Exits if the width is too small, the memory can't be allocated or
+ * EXPLICIT distances would have to be computed.
+ */
+void dist_matrix_build(struct dist_matrix *m, int n, double coords[], const double weights[],
+        enum dist_metric metric, enum dist_layout layout, enum dist_width width) {
+    build(m, n, coords, weights, metric, layout, width, 0);
+}
+
+/**
+ * Same as dist_matrix_build, but the entries are put in shared memory
+ * (see shared.h), so worker processes forked afterwards all read the same
+ * copy.
+ */
+void dist_matrix_build_shared(struct dist_matrix *m, int n, double coords[],
+        const double weights[], enum dist_metric metric, enum dist_layout layout,
+        enum dist_width width) {
+    build(m, n, coords, weights, metric, layout, width, 1);
+}
+
+/**
+ * Returns the kind of lookups the given matrix needs, to pick the copy of
+ * the inner loop code made for it.
+ */
+enum dist_kind dist_kind_of(const struct dist_matrix *m) {
+    if (m->layout == DIST_COMPUTED) {
+        switch (m->metric) {
+            case METRIC_EUC_2D:
+                return DIST_KIND_euc_2d;
+            case METRIC_CEIL_2D:
+                return DIST_KIND_ceil_2d;
+            case METRIC_ATT:
+                return DIST_KIND_att;
+            case METRIC_GEO:
+                return DIST_KIND_geo;
+            case METRIC_MAN_2D:
+                return DIST_KIND_man_2d;
+            default:
+                return DIST_KIND_trunc;
+        }
+    }
+    int packed = m->layout == DIST_PACKED;
+    switch (m->width) {
+        case DIST_U16:
+            return packed ? DIST_KIND_packed_u16 : DIST_KIND_full_u16;
+        case DIST_U32:
+            return packed ? DIST_KIND_packed_u32 : DIST_KIND_full_u32;
+        default:
+            return packed ? DIST_KIND_packed_float : DIST_KIND_full_float;
+    }
+}
+
+/**
+ * Makes dst a copy of src with its own memory, touched by the calling
+ * thread. On Linux that puts the pages on the calling thread's NUMA node.
+ * Exits if the memory can't be allocated.
+ */
+void dist_matrix_copy(struct dist_matrix *dst, const struct dist_matrix *src) {
+    *dst = *src;
+    dst->shared = 0;
+    if (src->layout == DIST_COMPUTED) {
+        return;
+    }
+    dst->row = (size_t *) malloc((src->n > 0 ? src->n : 1) * sizeof(size_t));
+    dst->data = malloc(src->bytes + sizeof(uint32_t));
+    if (dst->row == NULL || dst->data == NULL) {
+        printf("NOT ENOUGH MEMORY FOR %zu BYTES OF DISTANCES.\n", src->bytes);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(dst->row, src->row, src->n * sizeof(size_t));
+    memcpy(dst->data, src->data, src->bytes + sizeof(uint32_t));
+}
+
+/**
+ * Deallocates the memory used by the matrix.
+ */
+void dist_matrix_free(struct dist_matrix *m) {
+    if (m->shared) {
+        shared_free(m->data, m->bytes + sizeof(uint32_t));
+    } else {
+        free(m->data);
+    }
+    free(m->row);
+    m->data = NULL;
+    m->row = NULL;
+}
@@ -0,0 +1,170 @@
+/*
+ * Distance matrix stored in one contiguous block.
+ * The matrix can either hold every entry (full) or only the upper triangle
+ * including the diagonal (packed), which takes about half the memory since
+ * the distances are symmetric. Entries are 16 bit, 32 bit or float,
+ * whichever is the smallest that holds the longest possible distance.
+ * For instances too big for any matrix, the distances can instead be
+ * computed from the coordinates every time they're needed (computed).
+ *
+ * The distance between two nodes is given by a metric. TRUNC is the
+ * truncated Euclidean distance used for plain city files; the others are
+ * the TSPLIB edge weight types of the same name. EXPLICIT distances are
+ * given in the file instead of coordinates, so they can't be computed.
+ *
+ * Single distances are returned as long long, and path lengths are added
+ * up as long long too, so even 32 bit entries can't overflow a path.
+ *
+ * The code that looks up distances in inner loops is compiled once for
+ * every way of looking them up (a dist_kind), with the layout, width and
+ * metric fixed, and the right copy is picked once with dist_kind_of. See
+ * DIST_KINDS below and moves.c.
+ */
+#ifndef DIST_H
+#define DIST_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Above this many nodes the distances are computed instead of stored
+#define MATRIX_NODE_LIMIT 20000
+
+enum dist_layout { DIST_FULL, DIST_PACKED, DIST_COMPUTED };
+enum dist_width { DIST_AUTO, DIST_U16, DIST_U32, DIST_FLOAT };
+enum dist_metric {
+    METRIC_TRUNC, METRIC_EUC_2D, METRIC_CEIL_2D, METRIC_ATT, METRIC_GEO, METRIC_MAN_2D,
+    METRIC_EXPLICIT
+};
+
+struct dist_matrix {
+    int n; // number of nodes
+    enum dist_layout layout;
+    enum dist_width width;
+    enum dist_metric metric;
+    void *data; // the entries, see dist_index
+    size_t *row; // row[a] + b := index of the entry for a, b
+    size_t bytes; // size of data
+    const double *coords; // x, y values of the nodes, for DIST_COMPUTED
+    int shared; // 1 if data is in memory shared between processes
+};
+
+void dist_matrix_build(struct dist_matrix *m, int n, double coords[], const double weights[],
+        enum dist_metric metric, enum dist_layout layout, enum dist_width width);
+void dist_matrix_build_shared(struct dist_matrix *m, int n, double coords[],
+        const double weights[], enum dist_metric metric, enum dist_layout layout,
+        enum dist_width width);
+void dist_matrix_copy(struct dist_matrix *dst, const struct dist_matrix *src);
+void dist_matrix_free(struct dist_matrix *m);
+enum dist_width dist_width_for(int n, double coords[], const double weights[],
+        enum dist_metric metric);
+const char *dist_width_name(enum dist_width width);
+const char *dist_layout_name(enum dist_layout layout);
+const char *dist_metric_name(enum dist_metric metric);
+
+#define GEO_RADIUS 6378.388 // TSPLIB's radius of the earth in km
+
+/**
+ * The distance between node i and node j under the given metric. For GEO
+ * the coordinates must already be latitude and longitude in radians (see
+ * geo_radians in load.c). Not for EXPLICIT, which has no formula.
+ * With a constant metric the switch is compiled away.
+ */
+static inline double dist_metric(enum dist_metric metric, const double coords[], int i, int j) {
+    double dx = coords[i*2] - coords[j*2];
+    double dy = coords[i*2+1] - coords[j*2+1];
+    double d;
+    switch (metric) {
+        case METRIC_EUC_2D:
+            return floor(sqrt(dx*dx + dy*dy) + 0.5);
+        case METRIC_CEIL_2D:
+            return ceil(sqrt(dx*dx + dy*dy));
+        case METRIC_ATT:
+            d = sqrt((dx*dx + dy*dy) / 10.0);
+            return floor(d + 0.5) < d ? floor(d + 0.5) + 1 : floor(d + 0.5);
+        case METRIC_GEO: {
+            double q1 = cos(coords[i*2+1] - coords[j*2+1]);
+            double q2 = cos(coords[i*2] - coords[j*2]);
+            double q3 = cos(coords[i*2] + coords[j*2]);
+            return floor(GEO_RADIUS * acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) + 1.0);
+        }
+        case METRIC_MAN_2D:
+            return floor(fabs(dx) + fabs(dy) + 0.5);
+        default:
+            return floor(sqrt((float)(dx*dx + dy*dy)));
+    }
+}
+
+/**
+ * Returns the index into m->data of the distance between a and b.
+ */
+static inline size_t dist_index(const struct dist_matrix *m, int a, int b) {
+    if (m->layout == DIST_PACKED && a > b) {
+        int temp = a;
+        a = b;
+        b = temp;
+    }
+    return m->row[a] + b;
+}
+
+/**
+ * Returns the distance between a and b.
+ */
+static inline long long dist_matrix_get(const struct dist_matrix *m, int a, int b) {
+    if (m->layout == DIST_COMPUTED) {
+        return (long long) dist_metric(m->metric, m->coords, a, b);
+    }
+    size_t i = dist_index(m, a, b);
+    switch (m->width) {
+        case DIST_U16:
+            return ((const uint16_t *) m->data)[i];
+        case DIST_U32:
+            return ((const uint32_t *) m->data)[i];
+        default:
+            return (long long) ((const float *) m->data)[i];
+    }
+}
+
+/*
+ * Every way a distance can be looked up, as X(name, getter body) for
+ * X-macros. A stored entry depends on the layout and width, a computed
+ * one on the metric. EXPLICIT distances are always stored.
+ */
+#define DIST_STORED(layout, type) \
+    const type *data = (const type *) m->data; \
+    if (layout == DIST_PACKED && a > b) { \
+        int temp = a; \
+        a = b; \
+        b = temp; \
+    } \
+    return (long long) data[m->row[a] + b];
+#define DIST_KINDS(X) \
+    X(full_u16, DIST_STORED(DIST_FULL, uint16_t)) \
+    X(full_u32, DIST_STORED(DIST_FULL, uint32_t)) \
+    X(full_float, DIST_STORED(DIST_FULL, float)) \
+    X(packed_u16, DIST_STORED(DIST_PACKED, uint16_t)) \
+    X(packed_u32, DIST_STORED(DIST_PACKED, uint32_t)) \
+    X(packed_float, DIST_STORED(DIST_PACKED, float)) \
+    X(trunc, return (long long) dist_metric(METRIC_TRUNC, m->coords, a, b);) \
+    X(euc_2d, return (long long) dist_metric(METRIC_EUC_2D, m->coords, a, b);) \
+    X(ceil_2d, return (long long) dist_metric(METRIC_CEIL_2D, m->coords, a, b);) \
+    X(att, return (long long) dist_metric(METRIC_ATT, m->coords, a, b);) \
+    X(geo, return (long long) dist_metric(METRIC_GEO, m->coords, a, b);) \
+    X(man_2d, return (long long) dist_metric(METRIC_MAN_2D, m->coords, a, b);)
+
+#define DIST_KIND_ENUM(name, body) DIST_KIND_##name,
+enum dist_kind { DIST_KINDS(DIST_KIND_ENUM) NUM_DIST_KINDS };
+#undef DIST_KIND_ENUM
+
+// dist_get_<kind>(m, a, b) := the distance between a and b, for a matrix
+// of that kind only
+#define DIST_KIND_GETTER(name, body) \
+    static inline long long dist_get_##name(const struct dist_matrix *m, int a, int b) { \
+        body \
+    }
+DIST_KINDS(DIST_KIND_GETTER)
+#undef DIST_KIND_GETTER
+
+enum dist_kind dist_kind_of(const struct dist_matrix *m);
+
+#endif
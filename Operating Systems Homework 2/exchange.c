@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 200809L // for robust mutexes
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include "shared.h"
+#include "exchange.h"
+
+#if ATOMIC_INT_LOCK_FREE != 2
+#error "atomic ints must be lock free to be shared between processes"
+#endif
+
+#define READ_TRIES 1000 // copies tried before a reader gives up
+
+/**
+ * Returns the size of an exchange for paths of n nodes.
+ */
+static size_t exchange_size(int n) {
+    return sizeof(struct exchange) + (size_t) n * sizeof(atomic_int);
+}
+
+/**
+ * Creates an empty exchange in shared memory. Must be called before the
+ * workers are forked.
+ * @return The exchange, or NULL if it couldn't be allocated
+ */
+struct exchange *exchange_create(int n) {
+    struct exchange *e = (struct exchange *) shared_alloc(exchange_size(n));
+    if (e == NULL) {
+        return NULL;
+    }
+    e->n = n;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&e->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    atomic_init(&e->seq, 0);
+    atomic_init(&e->len, LLONG_MAX);
+    int i;
+    for (i = 0; i < n; i++) {
+        atomic_init(&e->path[i], i);
+    }
+    return e;
+}
+
+/**
+ * Unmaps the exchange from the calling process.
+ */
+void exchange_free(struct exchange *e) {
+    shared_free(e, exchange_size(e->n));
+}
+
+/**
+ * Returns the length of the exchanged path, LLONG_MAX if there is none.
+ */
+long long exchange_len(struct exchange *e) {
+    return atomic_load_explicit(&e->len, memory_order_relaxed);
+}
+
+/**
+ * Locks the exchange. If the last holder died while writing, the path may
+ * be half written, so it's thrown away.
+ */
+static void lock(struct exchange *e) {
+    if (pthread_mutex_lock(&e->lock) == EOWNERDEAD) {
+        unsigned seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+        if (seq & 1) {
+            atomic_store_explicit(&e->len, LLONG_MAX, memory_order_relaxed);
+            atomic_store_explicit(&e->seq, seq + 1, memory_order_release);
+        }
+        pthread_mutex_consistent(&e->lock);
+    }
+}
+
+/**
+ * Makes the given path the exchanged path if it's shorter.
+ * @return 1 if it was. Otherwise 0.
+ */
+int exchange_publish(struct exchange *e, const int path[], long long len) {
+    if (len >= exchange_len(e)) {
+        return 0;
+    }
+    lock(e);
+    int published = len < exchange_len(e);
+    if (published) {
+        unsigned seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+        atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        int i;
+        for (i = 0; i < e->n; i++) {
+            atomic_store_explicit(&e->path[i], path[i], memory_order_relaxed);
+        }
+        atomic_store_explicit(&e->len, len, memory_order_relaxed);
+        atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+    }
+    pthread_mutex_unlock(&e->lock);
+    return published;
+}
+
+/**
+ * Copies the exchanged path into path if it's shorter than *len, and sets
+ * *len to its length. Gives up if a writer keeps getting in the way.
+ * @return 1 if the path was copied. Otherwise 0.
+ */
+int exchange_copy(struct exchange *e, int path[], long long *len) {
+    int tries, i;
+    for (tries = 0; tries < READ_TRIES; tries++) {
+        unsigned before = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        long long l = atomic_load_explicit(&e->len, memory_order_relaxed);
+        if (l >= *len) {
+            return 0;
+        }
+        for (i = 0; i < e->n; i++) {
+            path[i] = atomic_load_explicit(&e->path[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) == before) {
+            *len = l;
+            return 1;
+        }
+    }
+    return 0;
+}
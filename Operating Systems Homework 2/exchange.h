@@ -0,0 +1,31 @@
+/*
+ * Best path exchange between worker processes, kept in shared memory.
+ *
+ * Writers take a process-shared mutex, so only one process writes at a
+ * time. The mutex is robust: if a worker dies while holding it, the next
+ * process to lock it is told and repairs the exchange instead of waiting
+ * forever. Readers never lock. They check a sequence number that is odd
+ * while the path is being written, and copy again if it changed during
+ * the copy (a seqlock).
+ */
+#ifndef EXCHANGE_H
+#define EXCHANGE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+struct exchange {
+    int n; // number of nodes in a path
+    pthread_mutex_t lock; // held by the process writing path
+    atomic_uint seq; // odd while path is being written
+    atomic_llong len; // length of path, LLONG_MAX until one is published
+    atomic_int path[];
+};
+
+struct exchange *exchange_create(int n);
+void exchange_free(struct exchange *e);
+long long exchange_len(struct exchange *e);
+int exchange_publish(struct exchange *e, const int path[], long long len);
+int exchange_copy(struct exchange *e, int path[], long long *len);
+
+#endif
@@ -0,0 +1,59 @@
+#include <math.h>
+#include <stdlib.h>
+#include "grid.h"
+
+/**
+ * Buckets the n nodes in coords into a grid with about per_cell nodes per
+ * cell. Done with a counting sort, so it takes O(n) time.
+ */
+void grid_build(struct grid *g, int n, const double coords[], int per_cell) {
+    double maxx, maxy;
+    int i, cells;
+
+    g->minx = g->miny = 0;
+    maxx = maxy = 0;
+    for (i = 0; i < n; i++) {
+        double x = coords[2*i], y = coords[2*i+1];
+        if (i == 0 || x < g->minx) g->minx = x;
+        if (i == 0 || x > maxx) maxx = x;
+        if (i == 0 || y < g->miny) g->miny = y;
+        if (i == 0 || y > maxy) maxy = y;
+    }
+    double w = maxx - g->minx, h = maxy - g->miny;
+    double side = ceil(sqrt((double) n / (per_cell > 0 ? per_cell : 1)));
+    g->size = (w > h ? w : h) / (side > 0 ? side : 1);
+    if (g->size <= 0) {
+        g->size = 1;
+    }
+    g->nx = (int) (w / g->size) + 1;
+    g->ny = (int) (h / g->size) + 1;
+    cells = g->nx * g->ny;
+
+    // Count the nodes in each cell, then turn the counts into start indexes
+    g->start = (int *) calloc(cells + 1, sizeof(int));
+    g->nodes = (int *) malloc((n > 0 ? n : 1) * sizeof(int));
+    for (i = 0; i < n; i++) {
+        int c = grid_row(g, coords[2*i+1]) * g->nx + grid_col(g, coords[2*i]);
+        g->start[c + 1]++;
+    }
+    for (i = 0; i < cells; i++) {
+        g->start[i + 1] += g->start[i];
+    }
+    int *fill = (int *) malloc(cells * sizeof(int));
+    for (i = 0; i < cells; i++) {
+        fill[i] = g->start[i];
+    }
+    for (i = 0; i < n; i++) {
+        int c = grid_row(g, coords[2*i+1]) * g->nx + grid_col(g, coords[2*i]);
+        g->nodes[fill[c]++] = i;
+    }
+    free(fill);
+}
+
+/**
+ * Deallocates the memory used by the grid.
+ */
+void grid_free(struct grid *g) {
+    free(g->start);
+    free(g->nodes);
+}
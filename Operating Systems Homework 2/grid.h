@@ -0,0 +1,37 @@
+/*
+ * Uniform grid over the node coordinates. The nodes are bucketed into
+ * square cells holding a couple of nodes each, so the nodes close to a
+ * point can be found by looking at the cells around it instead of at
+ * every node.
+ */
+#ifndef GRID_H
+#define GRID_H
+
+struct grid {
+    int nx, ny; // number of cells across and down
+    double minx, miny; // corner of the grid
+    double size; // side length of a cell
+    int *start; // cell c holds nodes[start[c]] .. nodes[start[c+1]-1]
+    int *nodes; // every node, sorted by cell
+};
+
+void grid_build(struct grid *g, int n, const double coords[], int per_cell);
+void grid_free(struct grid *g);
+
+/**
+ * Returns the column of the cell the given x value falls in.
+ */
+static inline int grid_col(const struct grid *g, double x) {
+    int c = (int) ((x - g->minx) / g->size);
+    return c < 0 ? 0 : c >= g->nx ? g->nx - 1 : c;
+}
+
+/**
+ * Returns the row of the cell the given y value falls in.
+ */
+static inline int grid_row(const struct grid *g, double y) {
+    int r = (int) ((y - g->miny) / g->size);
+    return r < 0 ? 0 : r >= g->ny ? g->ny - 1 : r;
+}
+
+#endif
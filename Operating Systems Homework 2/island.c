@@ -0,0 +1,218 @@
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "island.h"
+
+struct island *islands;
+int num_islands;
+
+// One per island, in the slot after the threads'. Used by the thread that
+// moves migrants around to look at the islands' best paths.
+static struct best_reader *migrators;
+// One per island, in the slot after that. The migrating thread publishes
+// through these, so publishing never clears the epoch slot that keeps a
+// snapshot it acquired through migrators alive (see best_acquire). The
+// slot after that is the logger's (see log.h).
+static struct best_reader *senders;
+static const struct best_tour **sources; // each island's best while migrating
+
+/**
+ * Splits the given number of threads into count islands, all starting
+ * from the given path.
+ */
+void islands_init(int count, int threads, int n, int path[], long long len) {
+    int i;
+    num_islands = count;
+    islands = (struct island *) malloc(count * sizeof(struct island));
+    migrators = (struct best_reader *) malloc(count * sizeof(struct best_reader));
+    senders = (struct best_reader *) malloc(count * sizeof(struct best_reader));
+    sources = (const struct best_tour **) malloc(count * sizeof(struct best_tour *));
+    for (i = 0; i < count; i++) {
+        struct island *isl = &islands[i];
+        isl->threads = threads / count + (i < threads % count);
+        atomic_init(&isl->running, isl->threads);
+        isl->migrants = 0;
+        isl->last_len = len;
+        best_init(&isl->best, n, path, len, isl->threads + 3);
+        best_reader_init(&migrators[i], &isl->best, isl->threads);
+        best_reader_init(&senders[i], &isl->best, isl->threads + 1);
+    }
+}
+
+/**
+ * Deallocates the islands. Only call after every thread has been joined.
+ */
+void islands_free() {
+    int i;
+    for (i = 0; i < num_islands; i++) {
+        best_reader_free(&migrators[i]);
+        best_reader_free(&senders[i]);
+        best_free(&islands[i].best);
+    }
+    free(islands);
+    free(migrators);
+    free(senders);
+    free(sources);
+}
+
+/**
+ * Returns the island the given thread belongs to.
+ */
+struct island *island_of(int thread) {
+    return &islands[thread % num_islands];
+}
+
+/**
+ * Returns the best path slot the given thread uses on its island.
+ */
+int island_slot(int thread) {
+    return thread / num_islands;
+}
+
+/**
+ * Returns the best path slot the logger thread uses on the given island.
+ */
+int island_logger_slot(int island) {
+    return islands[island].threads + 2;
+}
+
+/**
+ * Returns the number of threads still climbing on all islands.
+ */
+int islands_running() {
+    int i, running = 0;
+    for (i = 0; i < num_islands; i++) {
+        running += atomic_load(&islands[i].running);
+    }
+    return running;
+}
+
+/**
+ * Offers island from's best path to island to.
+ * @return 1 if it became to's best path. Otherwise 0.
+ */
+static int send(int from, int to) {
+    if (best_publish(&senders[to], (int *) sources[from]->path, sources[from]->len)) {
+        islands[to].migrants++;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Sends every island's best path to its neighbors: the next island for
+ * a ring, or every other island for all-to-all. An island only takes a
+ * migrant that is better than its own best. All of the sources are
+ * looked at before anything is sent, so a path only moves one hop per
+ * call.
+ * @return The number of migrants taken
+ */
+int islands_migrate(enum topology topology) {
+    int i, j, taken = 0;
+    for (i = 0; i < num_islands; i++) {
+        sources[i] = best_acquire(&migrators[i]);
+    }
+    for (i = 0; i < num_islands && num_islands > 1; i++) {
+        if (topology == TOPOLOGY_RING) {
+            taken += send(i, (i + 1) % num_islands);
+        } else {
+            for (j = 0; j < num_islands; j++) {
+                if (j != i) {
+                    taken += send(i, j);
+                }
+            }
+        }
+    }
+    for (i = 0; i < num_islands; i++) {
+        best_release(&migrators[i]);
+    }
+    return taken;
+}
+
+/**
+ * Prints every island's best length and version (how many times it was
+ * replaced), migrants taken and running threads to stderr, if any island
+ * improved since the last report or force is set. Call from the thread
+ * that calls islands_migrate.
+ * @return 1 if anything was printed. Otherwise 0.
+ */
+int islands_report(int force) {
+    int i, changed = force;
+    for (i = 0; i < num_islands; i++) {
+        changed |= best_len(&islands[i].best) != islands[i].last_len;
+    }
+    if (!changed) {
+        return 0;
+    }
+    for (i = 0; i < num_islands; i++) {
+        struct island *isl = &islands[i];
+        const struct best_tour *b = best_acquire(&migrators[i]);
+        isl->last_len = b->len;
+        fprintf(stderr, "Island %d: best %lld (version %lu), %lu migrants taken, %d/%d running\n",
+                i, b->len, b->version, isl->migrants, atomic_load(&isl->running), isl->threads);
+        best_release(&migrators[i]);
+    }
+    return 1;
+}
+
+/**
+ * Returns the length of the best path over all islands. Safe to call while
+ * the threads are running.
+ */
+long long islands_best_len() {
+    long long len = best_len(&islands[0].best);
+    int i;
+    for (i = 1; i < num_islands; i++) {
+        long long l = best_len(&islands[i].best);
+        len = l < len ? l : len;
+    }
+    return len;
+}
+
+/**
+ * Copies the best path over all islands into path.
+ * Safe to call while the threads are running, from the thread that
+ * migrates.
+ * @return The length of the path copied
+ */
+long long islands_copy_best(int path[]) {
+    long long len = LLONG_MAX;
+    int i;
+    for (i = 0; i < num_islands; i++) {
+        best_copy(&migrators[i], path, &len);
+    }
+    return len;
+}
+
+/**
+ * Offers a path from somewhere else (another process) to every island, as
+ * a migrant. Only call from the thread that migrates.
+ * @return The number of islands it became the best path of
+ */
+int islands_offer(int path[], long long len) {
+    int i, taken = 0;
+    for (i = 0; i < num_islands; i++) {
+        if (best_publish(&senders[i], path, len)) {
+            islands[i].migrants++;
+            taken++;
+        }
+    }
+    return taken;
+}
+
+/**
+ * Returns the best path over all islands. Only safe after every thread
+ * has been joined.
+ */
+const struct best_tour *islands_best() {
+    const struct best_tour *best = NULL;
+    int i;
+    for (i = 0; i < num_islands; i++) {
+        const struct best_tour *b = best_current(&islands[i].best);
+        if (best == NULL || b->len < best->len) {
+            best = b;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,42 @@
+/*
+ * Island model. The threads are split into islands that each keep their
+ * own best path, so each island climbs in its own part of the search
+ * space instead of every thread being pulled to the same path. Every so
+ * often the best paths migrate to other islands, either around a ring or
+ * from every island to every other one.
+ *
+ * Thread t belongs to island t % num_islands. With one island every thread
+ * shares a single best path.
+ */
+#ifndef ISLAND_H
+#define ISLAND_H
+
+#include "best.h"
+
+enum topology { TOPOLOGY_RING, TOPOLOGY_ALL };
+
+struct island {
+    struct best_shared best;
+    int threads; // number of threads on the island
+    _Atomic int running; // number of those threads still climbing
+    unsigned long migrants; // migrants that became the island's best
+    long long last_len; // best length at the last report
+};
+
+extern struct island *islands;
+extern int num_islands;
+
+void islands_init(int count, int threads, int n, int path[], long long len);
+void islands_free();
+struct island *island_of(int thread);
+int island_slot(int thread);
+int island_logger_slot(int island);
+int islands_running();
+int islands_migrate(enum topology topology);
+int islands_report(int force);
+long long islands_best_len();
+long long islands_copy_best(int path[]);
+int islands_offer(int path[], long long len);
+const struct best_tour *islands_best();
+
+#endif
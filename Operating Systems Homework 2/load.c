@@ -0,0 +1,431 @@
+#define _POSIX_C_SOURCE 200809L // for mmap and posix_madvise
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "load.h"
+
+#define GEO_PI 3.141592 // the value of pi TSPLIB uses for GEO
+
+struct parser {
+    const char *p; // next character
+    const char *end; // one past the last character
+    const char *file; // for error messages
+};
+
+/**
+ * Prints an error message with the line the parser is on and exits.
+ */
+static void parse_error(struct parser *ps, const char *start, const char *message) {
+    int line = 1;
+    const char *c;
+    for (c = start; c < ps->p && c < ps->end; c++) {
+        line += *c == '\n';
+    }
+    printf("%s:%d: %s\n", ps->file, line, message);
+    exit(EXIT_FAILURE);
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/**
+ * Skips spaces, tabs and line breaks.
+ */
+static void skip_space(struct parser *ps) {
+    while (ps->p < ps->end && is_space(*ps->p)) {
+        ps->p++;
+    }
+}
+
+/**
+ * Skips spaces and tabs but not line breaks.
+ */
+static void skip_blank(struct parser *ps) {
+    while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\t')) {
+        ps->p++;
+    }
+}
+
+/**
+ * Returns 10^e.
+ */
+static double pow10_of(int e) {
+    static const double table[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    if (e >= 0 && e <= 22) {
+        return table[e];
+    }
+    return pow(10.0, e);
+}
+
+/**
+ * Parses a number such as "12", "-3.25" or "6.02e23" at the current
+ * position, after skipping whitespace.
+ * @return 1 if a number was parsed into *out. 0 if there's no number here.
+ */
+static int parse_number(struct parser *ps, double *out) {
+    skip_space(ps);
+    const char *p = ps->p, *end = ps->end;
+    int negative = 0, digits = 0, exponent = 0;
+    unsigned long long mantissa = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p++ == '-';
+    }
+    // Digits past the 19th don't fit, so they only move the exponent
+    for (; p < end && is_digit(*p); p++, digits++) {
+        if (mantissa < 1000000000000000000ULL) {
+            mantissa = mantissa * 10 + (*p - '0');
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && is_digit(*p); p++, digits++) {
+            if (mantissa < 1000000000000000000ULL) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) {
+        return 0;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int e = 0, e_negative = 0;
+        p++;
+        if (p < end && (*p == '-' || *p == '+')) {
+            e_negative = *p++ == '-';
+        }
+        for (; p < end && is_digit(*p); p++) {
+            if (e < 10000) {
+                e = e * 10 + (*p - '0');
+            }
+        }
+        exponent += e_negative ? -e : e;
+    }
+    double value = (double) mantissa;
+    value = exponent < 0 ? value / pow10_of(-exponent) : value * pow10_of(exponent);
+    *out = negative ? -value : value;
+    ps->p = p;
+    return 1;
+}
+
+/**
+ * Reads a header keyword (letters, digits and underscores) into key.
+ */
+static void parse_key(struct parser *ps, char *key, int size) {
+    int len = 0;
+    while (ps->p < ps->end && (*ps->p == '_' || is_digit(*ps->p)
+            || (*ps->p >= 'A' && *ps->p <= 'Z') || (*ps->p >= 'a' && *ps->p <= 'z'))) {
+        if (len < size - 1) {
+            key[len++] = *ps->p;
+        }
+        ps->p++;
+    }
+    key[len] = '\0';
+}
+
+/**
+ * Reads the rest of the line, without the ':' separator and surrounding
+ * blanks, into value.
+ */
+static void parse_value(struct parser *ps, char *value, int size) {
+    int len = 0;
+    skip_blank(ps);
+    if (ps->p < ps->end && *ps->p == ':') {
+        ps->p++;
+        skip_blank(ps);
+    }
+    while (ps->p < ps->end && *ps->p != '\n' && *ps->p != '\r') {
+        if (len < size - 1) {
+            value[len++] = *ps->p;
+        }
+        ps->p++;
+    }
+    while (len > 0 && is_space(value[len - 1])) {
+        len--;
+    }
+    value[len] = '\0';
+}
+
+/**
+ * Appends a node to the coordinate array, doubling its size when full.
+ */
+static void add_node(struct cities *c, int *capacity, double x, double y) {
+    if (c->n == *capacity) {
+        *capacity = *capacity > 0 ? *capacity * 2 : 1024;
+        c->coords = (double *) realloc(c->coords, (size_t) *capacity * 2 * sizeof(double));
+        if (c->coords == NULL) {
+            printf("NOT ENOUGH MEMORY FOR %d NODES.\n", *capacity);
+            exit(EXIT_FAILURE);
+        }
+    }
+    c->coords[2 * c->n] = x;
+    c->coords[2 * c->n + 1] = y;
+    c->n++;
+}
+
+/**
+ * Converts a TSPLIB GEO coordinate (DDD.MM, degrees and minutes) to radians.
+ */
+static double geo_radians(double v) {
+    int deg = (int) v;
+    double min = v - deg;
+    return GEO_PI * (deg + 5.0 * min / 3.0) / 180.0;
+}
+
+/**
+ * Parses a plain file of x y pairs. A trailing odd value is ignored.
+ */
+static void parse_plain(struct parser *ps, struct cities *c, int *capacity) {
+    const char *start = ps->p;
+    double x, y;
+    while (parse_number(ps, &x)) {
+        if (!parse_number(ps, &y)) {
+            break;
+        }
+        add_node(c, capacity, x, y);
+    }
+    skip_space(ps);
+    if (ps->p < ps->end) {
+        parse_error(ps, start, "expected a number");
+    }
+}
+
+/**
+ * Parses an EDGE_WEIGHT_SECTION of n nodes in the given format into
+ * c->weights. Only symmetric instances are supported, so the _COL formats
+ * are read as the _ROW format of the other triangle, and every weight is
+ * stored on both sides of the diagonal.
+ */
+static void parse_weights(struct parser *ps, const char *start, struct cities *c, int n,
+        const char *format) {
+    int full = strcmp(format, "FULL_MATRIX") == 0, i, j;
+    // Which triangle each row holds, and whether it includes the diagonal
+    int lower = strcmp(format, "LOWER_ROW") == 0 || strcmp(format, "UPPER_COL") == 0
+        || strcmp(format, "LOWER_DIAG_ROW") == 0 || strcmp(format, "UPPER_DIAG_COL") == 0;
+    int diag = strcmp(format, "UPPER_DIAG_ROW") == 0 || strcmp(format, "LOWER_DIAG_COL") == 0
+        || strcmp(format, "LOWER_DIAG_ROW") == 0 || strcmp(format, "UPPER_DIAG_COL") == 0;
+    if (!full && !lower && !diag && strcmp(format, "UPPER_ROW") != 0
+            && strcmp(format, "LOWER_COL") != 0) {
+        parse_error(ps, start, "unsupported EDGE_WEIGHT_FORMAT");
+    }
+    if (n < 1) {
+        parse_error(ps, start, "EDGE_WEIGHT_SECTION needs a DIMENSION first");
+    }
+    free(c->weights);
+    c->weights = (double *) calloc((size_t) n * n, sizeof(double));
+    if (c->weights == NULL) {
+        printf("NOT ENOUGH MEMORY FOR %d NODES.\n", n);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++) {
+        int first = full ? 0 : lower ? 0 : diag ? i : i + 1;
+        int last = full ? n - 1 : !lower ? n - 1 : diag ? i : i - 1;
+        for (j = first; j <= last; j++) {
+            double w;
+            if (!parse_number(ps, &w)) {
+                parse_error(ps, start, "expected an edge weight");
+            }
+            c->weights[(size_t) i * n + j] = w;
+            if (!full) {
+                c->weights[(size_t) j * n + i] = w;
+            }
+        }
+    }
+}
+
+/**
+ * Parses a TSPLIB file: the header, then the node coordinates or the
+ * edge weights.
+ */
+static void parse_tsplib(struct parser *ps, struct cities *c, int *capacity) {
+    const char *start = ps->p;
+    char key[64], value[256], format[256] = "";
+    int in_coords = 0, dimension = 0;
+    c->metric = METRIC_EUC_2D;
+
+    for (skip_space(ps); ps->p < ps->end; skip_space(ps)) {
+        double id, x, y;
+        if (in_coords && parse_number(ps, &id)) {
+            if (!parse_number(ps, &x) || !parse_number(ps, &y)) {
+                parse_error(ps, start, "expected 'id x y'");
+            }
+            add_node(c, capacity, x, y);
+            continue;
+        }
+        parse_key(ps, key, sizeof(key));
+        if (key[0] == '\0') {
+            parse_error(ps, start, "expected a keyword");
+        }
+        if (strcmp(key, "NODE_COORD_SECTION") == 0
+                || (strcmp(key, "DISPLAY_DATA_SECTION") == 0 && c->metric == METRIC_EXPLICIT)) {
+            in_coords = 1;
+            continue;
+        }
+        if (strcmp(key, "EDGE_WEIGHT_SECTION") == 0) {
+            if (c->metric != METRIC_EXPLICIT) {
+                parse_error(ps, start, "EDGE_WEIGHT_SECTION needs EDGE_WEIGHT_TYPE : EXPLICIT");
+            }
+            parse_weights(ps, start, c, dimension, format);
+            in_coords = 0;
+            continue;
+        }
+        in_coords = 0;
+        if (strcmp(key, "EOF") == 0) {
+            break;
+        }
+        parse_value(ps, value, sizeof(value));
+        if (strcmp(key, "TYPE") == 0 && strncmp(value, "TSP", 3) != 0) {
+            parse_error(ps, start, "only TYPE : TSP is supported");
+        } else if (strcmp(key, "DIMENSION") == 0) {
+            dimension = atoi(value);
+            if (dimension > *capacity) {
+                *capacity = dimension;
+                c->coords = (double *) realloc(c->coords, (size_t) dimension * 2 * sizeof(double));
+                if (c->coords == NULL) {
+                    printf("NOT ENOUGH MEMORY FOR %d NODES.\n", dimension);
+                    exit(EXIT_FAILURE);
+                }
+            }
+        } else if (strcmp(key, "EDGE_WEIGHT_TYPE") == 0) {
+            if (strcmp(value, "EUC_2D") == 0) {
+                c->metric = METRIC_EUC_2D;
+            } else if (strcmp(value, "CEIL_2D") == 0) {
+                c->metric = METRIC_CEIL_2D;
+            } else if (strcmp(value, "ATT") == 0) {
+                c->metric = METRIC_ATT;
+            } else if (strcmp(value, "GEO") == 0) {
+                c->metric = METRIC_GEO;
+            } else if (strcmp(value, "MAN_2D") == 0) {
+                c->metric = METRIC_MAN_2D;
+            } else if (strcmp(value, "EXPLICIT") == 0) {
+                c->metric = METRIC_EXPLICIT;
+            } else {
+                parse_error(ps, start, "unsupported EDGE_WEIGHT_TYPE");
+            }
+        } else if (strcmp(key, "EDGE_WEIGHT_FORMAT") == 0) {
+            strcpy(format, value);
+        } else if (strcmp(key, "DISPLAY_DATA_SECTION") == 0 || strcmp(key, "TOUR_SECTION") == 0) {
+            parse_error(ps, start, "only NODE_COORD_SECTION and EDGE_WEIGHT_SECTION are supported");
+        }
+    }
+    if (c->metric == METRIC_EXPLICIT) {
+        if (c->weights == NULL) {
+            parse_error(ps, start, "EXPLICIT needs an EDGE_WEIGHT_SECTION");
+        }
+        if (c->n != dimension) {
+            // No display data, so every node is put at 0, 0
+            c->n = 0;
+            while (c->n < dimension) {
+                add_node(c, capacity, 0, 0);
+            }
+        }
+    }
+    if (c->metric == METRIC_GEO) {
+        int i;
+        for (i = 0; i < 2 * c->n; i++) {
+            c->coords[i] = geo_radians(c->coords[i]);
+        }
+    }
+}
+
+/**
+ * Reads everything left in fd into a buffer, for files that can't be
+ * mapped (pipes, terminals, /dev/stdin).
+ * @param size Set to the number of bytes read
+ * @return The buffer, which the caller has to free
+ */
+static char *read_all(int fd, const char *file, size_t *size) {
+    size_t capacity = 65536;
+    char *data = (char *) malloc(capacity);
+    *size = 0;
+    while (data != NULL) {
+        if (*size == capacity) {
+            capacity *= 2;
+            data = (char *) realloc(data, capacity);
+            if (data == NULL) {
+                break;
+            }
+        }
+        ssize_t got = read(fd, data + *size, capacity - *size);
+        if (got == 0) {
+            return data;
+        }
+        if (got == -1 && errno != EINTR) {
+            printf("FILE '%s' CAN'T BE READ.\n", file);
+            exit(EXIT_FAILURE);
+        }
+        *size += got > 0 ? got : 0;
+    }
+    printf("NOT ENOUGH MEMORY TO READ '%s'.\n", file);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Loads the nodes in the given file into c. A file starting with a letter
+ * is read as TSPLIB, anything else as plain x y pairs. Regular files are
+ * mapped; anything else (a pipe, /dev/stdin) is read into memory first.
+ * Prints an error and exits if the file can't be read or parsed.
+ */
+void load_cities(const char *file, struct cities *c) {
+    int capacity = 0;
+    c->n = 0;
+    c->coords = NULL;
+    c->weights = NULL;
+    c->metric = METRIC_TRUNC;
+
+    int fd = open(file, O_RDONLY);
+    if (fd == -1) {
+        printf("FILE '%s' NOT FOUND.\n", file);
+        exit(EXIT_FAILURE);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        printf("FILE '%s' CAN'T BE READ.\n", file);
+        exit(EXIT_FAILURE);
+    }
+    const char *data = NULL;
+    size_t size = st.st_size;
+    char *buffer = NULL;
+    if (!S_ISREG(st.st_mode)) {
+        buffer = read_all(fd, file, &size);
+        data = buffer;
+    } else if (size > 0) {
+        data = (const char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            printf("FILE '%s' CAN'T BE MAPPED.\n", file);
+            exit(EXIT_FAILURE);
+        }
+        posix_madvise((void *) data, st.st_size, POSIX_MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    struct parser ps = { data, data + size, file };
+    skip_space(&ps);
+    if (ps.p < ps.end && ((*ps.p >= 'A' && *ps.p <= 'Z') || (*ps.p >= 'a' && *ps.p <= 'z'))) {
+        parse_tsplib(&ps, c, &capacity);
+    } else {
+        parse_plain(&ps, c, &capacity);
+    }
+
+    if (buffer != NULL) {
+        free(buffer);
+    } else if (data != NULL) {
+        munmap((void *) data, size);
+    }
+}
@@ -0,0 +1,30 @@
+/*
+ * Loads node coordinates from a file. Two formats are understood:
+ *    plain: whitespace separated x y values, one pair per node (cities.txt)
+ *    TSPLIB: "KEY : VALUE" header lines followed by a NODE_COORD_SECTION
+ *            of "id x y" lines, with EDGE_WEIGHT_TYPE EUC_2D, CEIL_2D, ATT,
+ *            GEO or MAN_2D. Or EDGE_WEIGHT_TYPE EXPLICIT with an
+ *            EDGE_WEIGHT_SECTION in any of the EDGE_WEIGHT_FORMATs
+ *            FULL_MATRIX, UPPER_ROW, LOWER_ROW, UPPER_DIAG_ROW,
+ *            LOWER_DIAG_ROW or their _COL versions, and optionally a
+ *            DISPLAY_DATA_SECTION of "id x y" lines.
+ * Values may be integers or decimals. The file is mapped into memory and
+ * parsed in a single pass, so nothing is copied through stdio.
+ */
+#ifndef LOAD_H
+#define LOAD_H
+
+#include "dist.h"
+
+struct cities {
+    int n; // number of nodes
+    double *coords; // coords[2*i], coords[2*i+1] := x, y of node i
+    enum dist_metric metric; // TRUNC for plain files
+    // For EXPLICIT, weights[i*n + j] := distance from i to j, and coords
+    // are the display data, or all 0 if there is none. Otherwise NULL.
+    double *weights;
+};
+
+void load_cities(const char *file, struct cities *c);
+
+#endif
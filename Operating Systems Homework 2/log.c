@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L // for nanosleep and flockfile
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include "counters.h"
+#include "island.h"
+#include "log.h"
+
+#define LOG_CHUNK 65536 // bytes formatted before they're handed to stdio
+
+enum log_level log_level = LOG_PROGRESS;
+int log_gap_ms = 0;
+
+static pthread_t logger;
+static atomic_int stopping;
+static struct best_reader *readers; // one per island, in its logger slot
+static int *log_path; // the path being printed, copied out of a snapshot
+static int log_nodes;
+static long long log_printed; // length of the last path printed
+
+/**
+ * Writes the digits of the non-negative value v to buf.
+ * @return The number of characters written
+ */
+static int format_int(char *buf, long long v) {
+    char digits[20];
+    int count = 0, i;
+    do {
+        digits[count++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    for (i = 0; i < count; i++) {
+        buf[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+/**
+ * Prints the length and path given, as "length. node node ...", and
+ * flushes. The line is formatted into LOG_CHUNK sized pieces instead of
+ * going through printf once per node.
+ */
+void log_write_path(FILE *out, const int path[], int n, long long length) {
+    static _Thread_local char buf[LOG_CHUNK + 32];
+    int used = 0, i;
+    if (length < 0) {
+        buf[used++] = '-';
+        length = -length;
+    }
+    used += format_int(&buf[used], length);
+    buf[used++] = '.';
+    flockfile(out);
+    for (i = 0; i < n; i++) {
+        if (used >= LOG_CHUNK) {
+            fwrite(buf, 1, used, out);
+            used = 0;
+        }
+        buf[used++] = ' ';
+        used += format_int(&buf[used], path[i]);
+    }
+    buf[used++] = '\n';
+    fwrite(buf, 1, used, out);
+    fflush(out);
+    funlockfile(out);
+}
+
+/**
+ * The logger thread. Copies the best path out of its snapshot before
+ * printing, so a slow stdout never holds back freeing snapshots.
+ */
+static void *log_run(void *arg) {
+    (void) arg;
+    struct timespec poll = { 0, LOG_POLL_MS * 1000000L };
+    long long next_ns = 0;
+    while (!atomic_load(&stopping)) {
+        nanosleep(&poll, NULL);
+        int best = 0, i;
+        for (i = 1; i < num_islands; i++) {
+            if (best_len(&islands[i].best) < best_len(&islands[best].best)) {
+                best = i;
+            }
+        }
+        long long len = best_len(&islands[best].best);
+        if (len >= log_printed
+                || (log_level == LOG_PROGRESS && log_printed - len < LOG_MIN_GAIN)
+                || counters_now_ns() < next_ns) {
+            continue;
+        }
+        len = LLONG_MAX;
+        best_copy(&readers[best], log_path, &len);
+        log_write_path(stdout, log_path, log_nodes, len);
+        log_printed = len;
+        next_ns = counters_now_ns() + log_gap_ms * 1000000LL;
+    }
+    return NULL;
+}
+
+/**
+ * Starts the logger thread on the islands, which must be set up already.
+ * @param n Number of nodes in a path
+ * @param printed Length of the path printed last, usually the starting one
+ */
+void log_start(int n, long long printed) {
+    int i;
+    log_nodes = n;
+    log_printed = printed;
+    log_path = (int *) malloc(n * sizeof(int));
+    readers = (struct best_reader *) malloc(num_islands * sizeof(struct best_reader));
+    for (i = 0; i < num_islands; i++) {
+        best_reader_init(&readers[i], &islands[i].best, island_logger_slot(i));
+    }
+    atomic_init(&stopping, 0);
+    pthread_create(&logger, NULL, log_run, NULL);
+}
+
+/**
+ * Stops the logger thread and waits for it to finish the path it's
+ * printing, if any. Paths published since aren't printed.
+ */
+void log_stop() {
+    int i;
+    atomic_store(&stopping, 1);
+    pthread_join(logger, NULL);
+    for (i = 0; i < num_islands; i++) {
+        best_reader_free(&readers[i]);
+    }
+    free(readers);
+    free(log_path);
+}
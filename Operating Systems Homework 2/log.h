@@ -0,0 +1,32 @@
+/*
+ * Prints the best path as it improves, from a thread of its own.
+ *
+ * The hill climbing threads never print. They only publish better paths
+ * (see best.h), and the logger thread looks at the islands' best lengths
+ * every LOG_POLL_MS. When one went down enough, it formats that island's
+ * best path into one buffer and writes it out in one go. If stdout is slow
+ * (a full pipe, a terminal) only the logger waits, and whatever paths were
+ * published in the meantime are skipped: it always prints the newest one.
+ */
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+
+#define LOG_POLL_MS 1 // how often the logger looks for a better path
+#define LOG_MIN_GAIN 1000 // at LOG_PROGRESS, how much better a path has to be to print it
+
+enum log_level {
+    LOG_FINAL, // only the best path at the end
+    LOG_PROGRESS, // also the starting path and improvements of LOG_MIN_GAIN
+    LOG_EVERY // every improvement the logger sees
+};
+
+extern enum log_level log_level;
+extern int log_gap_ms; // least time between two printed paths
+
+void log_write_path(FILE *out, const int path[], int n, long long length);
+void log_start(int n, long long printed);
+void log_stop();
+
+#endif
@@ -2,329 +2,1255 @@
  * BEST PATH FOUND Threads=64, tries=1000
  * 38714. 3 34 44 9 23 31 20 42 16 26 18 36 5 29 27 35 43 17 6 30 37 8 7 0 15 21 39 46 19 32 45 14 11 10 13 33 40 2 22 12 24 38 47 4 28 1 41 25
  */
+#define _POSIX_C_SOURCE 200809L // for getopt and getpid
+#include <limits.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h> // for IO redirection
-#include <fcntl.h> // for file creation
+#include <string.h>
+#include <time.h>
+#include <unistd.h> // for getopt
+#include <sys/wait.h>
 #include <math.h> // compile with -lm
+#include "tsp.h"
+#include "tour.h"
+#include "neighbors.h"
+#include "moves.h"
+#include "rng.h"
+#include "best.h"
+#include "island.h"
+#include "load.h"
+#include "bench.h"
+#include "counters.h"
+#include "simd.h"
+#include "construct.h"
+#include "checkpoint.h"
+#include "exchange.h"
+#include "numa.h"
+#include "log.h"
+#include "accept.h"
 
 #define NUM_THREADS 64
 #define NUM_TRIES 100
 #define FILE_NAME "cities.txt"
+#define DEFAULT_MOVES "2opt,oropt"
+#define DEFAULT_NEIGHBORS 10
+#define MAX_MOVES 10
+#define DEFAULT_BUILDERS "random"
+#define MAX_BUILDERS 10
+#define DEFAULT_POLICIES "strict"
+#define MAX_POLICIES 10
+#define DEFAULT_MIGRATION_MS 100
+#define SAMPLE_MS 10 // how often the main thread checks on the threads
+#define DEFAULT_CHECKPOINT_SECONDS 60
+#define CHECKPOINT_WAIT_MS 100 // how long a checkpoint waits for the threads
+#define RNG_FINAL -1 // saved_rng.request of a thread that has finished
+#define LIST_OFFER_NS 10000000LL // how often list tours are offered while improving
 
 // Method for threads to execute
 void* thread_hill_climb(void*);
 
+// Where a thread ran
+struct thread_place {
+    int cpu; // the CPU it was pinned to, or -1
+    int start_cpu, end_cpu; // the CPU it was on when it started and finished
+    int node; // the NUMA node of start_cpu, whose distances it read
+};
+
+// A thread's random number generator as of the last checkpoint request,
+// on its own cache line
+struct saved_rng {
+    _Alignas(64) atomic_ullong s[4];
+    atomic_int request; // the request it was saved for, or RNG_FINAL
+};
+
 // Initialization methods
+void parse_args(int argc, char *argv[]);
+void parse_moves(char *list);
+void parse_builders(char *list);
+void parse_policies(char *list);
 void init_dists(); // Tested and works 100%
 void init_path(); 
 
 // Helper methods 
-int find_path_len(int path[]);
-void switch_pvalues(int path[], int index1, int index2);
-void print_path(int path[], int length);
+void print_path(int path[], long long length);
 float distance(int x1, int y1, int x2, int y2);
-int rand_int(int n);
+void usage(char *name);
+void sleep_ms(int ms);
+double now_seconds();
+double cpu_seconds();
+void save_rng(struct saved_rng *slot, const struct rng *rng, int request);
+void load_rng(struct saved_rng *slot, struct rng *rng);
+void write_checkpoint(double elapsed);
+void stop_handler(int sig);
+void run_workers();
+void build_replicas();
+void* build_replica(void *node);
+void report_places();
+void sync_exchange(int path[]);
+void add_sample(struct run_stats *stats, double seconds, long long len);
 
-// Synchronized methods for threads to access the critical section
-int compare_and_copy_bpath(int path[], int *length);
-void compare_and_update_bpath(int path[], int length);
+// Lock-free methods for threads to share the best path
+int compare_and_copy_bpath(struct best_reader *r, struct counters *c, int path[], long long *length);
+void compare_and_update_bpath(struct best_reader *r, struct counters *c, struct tour *t, long long length);
+void offer_path(struct best_reader *r, struct counters *c, struct tour *t, long long length,
+                long long *offer_at);
 
 int num_nodes; // number of nodes loaded
-int min_len; // current minimum round trip length
-int *min_path; // the current minimum path (array)
-// dists[a][b] == dists[b][a] := distance from a to b
-int **dists; // 2D array filled with distances between nodes.
+long long min_len; // length of the starting path
+int *min_path; // the starting path (array). See best.h for the best one.
+double *coords; // x, y values of the nodes
+struct dist_matrix dists; // distances between every two nodes
+_Thread_local const struct dist_matrix *thread_dists = &dists;
+enum dist_layout dist_layout = DIST_FULL;
+int dist_layout_given = 0; // if 0, big instances switch to DIST_COMPUTED
+enum dist_width dist_width = DIST_AUTO;
+enum tour_layout tour_layout = TOUR_ARRAY; // how each thread stores its tour
+int tour_layout_given = 0; // if 0, big instances switch to TOUR_LIST
 
-int last_len;
+// The move types each thread uses, tried in this order
+const struct move_type *moves[MAX_MOVES];
+int num_moves;
+int neighbor_count = DEFAULT_NEIGHBORS;
+// How the starting paths are built. Thread t starts from starts[t % num_starts].
+const struct builder *starts[MAX_BUILDERS];
+int num_starts;
+// How random swaps are accepted. Thread t uses policies[t % num_policies].
+struct accept_policy policies[MAX_POLICIES];
+int num_policies;
+int num_threads = NUM_THREADS;
+uint64_t seed; // master seed every thread's generator is derived from
+char *file_name = FILE_NAME; // where the nodes are loaded from
+int island_count = 1;
+enum topology topology = TOPOLOGY_RING;
+int migration_ms = DEFAULT_MIGRATION_MS; // time between migrations
+char *bench_prefix = NULL; // if set, run the benchmarks instead
+int quiet = 0; // if set, don't print paths
+double time_limit = 0; // seconds before the threads are stopped, 0 for none
+double cpu_limit = 0; // CPU seconds before the threads are stopped, 0 for none
+int num_tries = NUM_TRIES; // failed random swaps before a thread stops, 0 for no limit
+char *checkpoint_file = NULL; // where checkpoints go, if anywhere
+double checkpoint_seconds = DEFAULT_CHECKPOINT_SECONDS; // time between checkpoints
+char *resume_file = NULL; // checkpoint to start from, if any
+struct checkpoint resume; // read from resume_file
+int num_procs = 1; // worker processes, see run_workers
+int pin_workers = 0; // if set, worker w runs on NUMA node w % nodes
+int stream_base = 0; // this process's first random stream
+struct exchange *exchange = NULL; // best path shared with the other workers
+char *placement = NULL; // thread placement policy, see numa.h
+int *place_cpus; // thread t runs on place_cpus[t % num_place_cpus]
+int num_place_cpus = 0;
+int replicate = 0; // if set, every NUMA node gets its own copy of dists
+struct dist_matrix *replicas = NULL; // replicas[node] := that node's copy
+int num_replicas = 0;
+struct thread_place *places; // places[t] := where thread t ran
+int report_ms = 0; // time between live counter reports, 0 for none
 
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+atomic_int stop_search; // set to make every thread stop climbing
+atomic_int checkpoint_request; // raised to ask the threads to save their generators
+struct saved_rng *saved_rngs; // saved_rngs[t] := thread t's saved generator
 
-int main() {
-    srand(time(NULL));
+int main(int argc, char *argv[]) {
+    parse_args(argc, argv);
+    if (bench_prefix != NULL) {
+        run_benchmarks(bench_prefix);
+        return EXIT_SUCCESS;
+    }
     init_dists();
+    if (resume_file != NULL) {
+        checkpoint_read(resume_file, &resume);
+        if (resume.n != num_nodes) {
+            printf("CHECKPOINT '%s' HAS %d NODES, NOT %d.\n", resume_file, resume.n, num_nodes);
+            exit(EXIT_FAILURE);
+        }
+        seed = resume.seed;
+        fprintf(stderr, "Resuming from %s: length %lld after %.1fs\n", resume_file,
+                resume.len, resume.elapsed);
+    }
+    fprintf(stderr, "Seed: %llu\n", (unsigned long long) seed);
+    if (replicate) {
+        build_replicas();
+    }
+
+    // Stop the threads cleanly on a kill, so the best path is still printed
+    // and checkpointed. A second one kills the program as usual.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    struct run_stats stats = {0};
+    if (num_procs > 1) {
+        run_workers();
+    } else {
+        solve(&stats);
+    }
+    
+    // Deallocate some memory
+    free(stats.times);
+    free(stats.lens);
+    int i;
+    for (i = 0; i < num_replicas; i++) {
+        dist_matrix_free(&replicas[i]);
+    }
+    free(replicas);
+    free(place_cpus);
+    free(coords);
+    dist_matrix_free(&dists);
+    if (resume_file != NULL) {
+        checkpoint_free(&resume);
+    }
+    
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Runs the hill climbing threads on the loaded nodes until they're all done
+ * (or time_limit or cpu_limit runs out) and prints the best path found.
+ * While they run, the main thread moves the best paths between islands,
+ * records the best length over time and writes checkpoints.
+ * @param stats Filled with the results of the run. times and lens must be
+ *              NULL or allocated with malloc.
+ */
+void solve(struct run_stats *stats) {
+    int i;
+    if (!tour_layout_given) {
+        tour_layout = num_nodes > TOUR_LIST_NODE_LIMIT ? TOUR_LIST : TOUR_ARRAY;
+    }
+    if (tour_layout == TOUR_LIST) {
+        fprintf(stderr, "Tours: two-level lists\n");
+    }
+    if (num_policies > 1 || policies[0].kind != ACCEPT_STRICT) {
+        fprintf(stderr, "Acceptance:");
+        for (i = 0; i < num_policies; i++) {
+            fprintf(stderr, " %s", accept_name(policies[i].kind));
+        }
+        fprintf(stderr, "\n");
+    }
+    init_neighbors(neighbor_count);
     init_path();
+    islands_init(island_count, num_threads, num_nodes, min_path, min_len);
+    counters_init(num_threads);
+    atomic_init(&stop_search, 0);
+    atomic_init(&checkpoint_request, 0);
+    places = (struct thread_place *) malloc(num_threads * sizeof(struct thread_place));
+    saved_rngs = (struct saved_rng *) aligned_alloc(64, num_threads * sizeof(struct saved_rng));
+    for (i = 0; i < num_threads; i++) {
+        // Every thread's generator carries on from the checkpoint if
+        // there is one. Stream 0 is the main thread's.
+        struct rng rng;
+        if (resume_file != NULL && i < resume.threads) {
+            rng = resume.rngs[i];
+        } else {
+            rng_seed(&rng, seed, stream_base + i + 1);
+        }
+        save_rng(&saved_rngs[i], &rng, 0);
+    }
+    stats->samples = 0;
 
-    print_path(min_path, min_len);
+    // Improvements are printed by the logger thread, so the threads never
+    // wait on stdout
+    int logging = !quiet && log_level > LOG_FINAL;
+    if (logging) {
+        print_path(min_path, min_len);
+        log_start(num_nodes, min_len);
+    }
 
-    pthread_t t[NUM_THREADS];
+    pthread_t *t = (pthread_t *) malloc(num_threads * sizeof(pthread_t));
+    int *ids = (int *) malloc(num_threads * sizeof(int));
 
     pthread_attr_t attr; // set thread detached attribute
     pthread_attr_init(&attr); // uses dynamic memory allocation
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
 
     // Create and run the threads
-    int i;
-    for (i = 0; i < NUM_THREADS; i++) {
-        pthread_create(&t[i], &attr, thread_hill_climb, NULL);
+    double start = now_seconds(), cpu_start = cpu_seconds();
+    add_sample(stats, 0, min_len);
+    for (i = 0; i < num_threads; i++) {
+        ids[i] = i;
+        pthread_create(&t[i], &attr, thread_hill_climb, &ids[i]);
     }
     pthread_attr_destroy(&attr);
 
+    // Until every thread is done, move the best paths between the islands
+    // and keep track of the best length
+    double next_migration = migration_ms / 1000.0;
+    double next_report = report_ms / 1000.0;
+    double next_checkpoint = checkpoint_seconds;
+    double next_exchange = migration_ms / 1000.0;
+    int *exchanged = exchange != NULL ? (int *) malloc(num_nodes * sizeof(int)) : NULL;
+    while (islands_running() > 0) {
+        sleep_ms(SAMPLE_MS);
+        double elapsed = now_seconds() - start;
+        if (num_islands > 1 && elapsed >= next_migration) {
+            islands_migrate(topology);
+            if (!quiet) {
+                islands_report(0);
+            }
+            next_migration += migration_ms / 1000.0;
+        }
+        if (exchange != NULL && elapsed >= next_exchange) {
+            sync_exchange(exchanged);
+            next_exchange += migration_ms / 1000.0;
+        }
+        if (report_ms > 0 && elapsed >= next_report) {
+            counters_report(elapsed, islands_best_len());
+            next_report += report_ms / 1000.0;
+        }
+        if (checkpoint_file != NULL && elapsed >= next_checkpoint) {
+            write_checkpoint(elapsed);
+            next_checkpoint = (now_seconds() - start) + checkpoint_seconds;
+        }
+        if ((time_limit > 0 && elapsed >= time_limit)
+                || (cpu_limit > 0 && cpu_seconds() - cpu_start >= cpu_limit)) {
+            atomic_store(&stop_search, 1);
+        }
+        add_sample(stats, elapsed, islands_best_len());
+    }
+
     // Join the threads
-    for (i = 0; i < NUM_THREADS; i++) {
+    for (i = 0; i < num_threads; i++) {
         pthread_join(t[i], 0);
     }
+    stats->seconds = now_seconds() - start;
+    if (logging) {
+        log_stop();
+    }
+    if (checkpoint_file != NULL) {
+        write_checkpoint(stats->seconds);
+    }
+    if (exchange != NULL) {
+        sync_exchange(exchanged);
+        free(exchanged);
+    }
+    if (num_islands > 1 && !quiet) {
+        islands_report(1);
+    }
+    const struct best_tour *best = islands_best();
+    stats->len = best->len;
+    struct counter_totals totals;
+    counters_sum(&totals);
+    stats->moves = totals.moves;
+    stats->accepts = totals.accepts;
+    add_sample(stats, stats->seconds, best->len);
+    if (!quiet) {
+        print_path((int *) best->path, best->len);
+    }
+    if (report_ms > 0) {
+        counters_summary(stats->seconds);
+    }
+    if (num_place_cpus > 0 || replicas != NULL) {
+        report_places();
+    }
     
     // Deallocate some memory
+    free(t);
+    free(ids);
     free(min_path);
-    for(i = 0; i < num_nodes; i++)
-    {
-        free(dists[i]);
+    islands_free();
+    free_neighbors();
+    counters_free();
+    free(saved_rngs);
+    free(places);
+}
+
+/**
+ * Runs num_procs worker processes, each solving with num_threads threads
+ * of its own. They share the distance matrix and trade best paths through
+ * an exchange in shared memory every migration_ms. This process only
+ * prints the exchanged path as it improves, and the best one at the end.
+ * A worker that dies is reported and the others carry on.
+ */
+void run_workers() {
+    exchange = exchange_create(num_nodes);
+    if (exchange == NULL) {
+        printf("COULD NOT CREATE THE SHARED BEST PATH.\n");
+        exit(EXIT_FAILURE);
     }
-    free(dists);
-    
-    return EXIT_SUCCESS;
+    pid_t *pids = (pid_t *) malloc(num_procs * sizeof(pid_t));
+    int nodes = numa_node_count(), started, i;
+    fflush(stdout); // so the workers don't print it again
+    fflush(stderr);
+    for (started = 0; started < num_procs; started++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            fprintf(stderr, "Could not start worker %d, carrying on with %d\n", started, started);
+            break;
+        }
+        if (pid == 0) {
+            if (pin_workers && !numa_bind_node(started % nodes)) {
+                fprintf(stderr, "Worker %d could not be bound to NUMA node %d\n",
+                        started, started % nodes);
+            }
+            stream_base = started * (num_threads + 1);
+            quiet = 1;
+            struct run_stats stats = {0};
+            solve(&stats);
+            fprintf(stderr, "Worker %d: best %lld after %.2fs\n", started, stats.len, stats.seconds);
+            exit(EXIT_SUCCESS);
+        }
+        pids[started] = pid;
+    }
+
+    // Print the exchanged path as it improves until every worker is done
+    int *path = (int *) malloc(num_nodes * sizeof(int));
+    long long len = LLONG_MAX, printed = LLONG_MAX;
+    double next_print = 0;
+    int running = started, forwarded = 0, status;
+    while (running > 0) {
+        sleep_ms(SAMPLE_MS);
+        if (atomic_load(&stop_search) && !forwarded) {
+            // Pass a kill on, so the workers stop cleanly too
+            for (i = 0; i < started; i++) {
+                if (pids[i] != 0) {
+                    kill(pids[i], SIGTERM);
+                }
+            }
+            forwarded = 1;
+        }
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (i = 0; i < started && pids[i] != pid; i++);
+            if (i < started) {
+                pids[i] = 0;
+                running--;
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+                fprintf(stderr, "Worker %d failed (status %d)\n", i, status);
+            }
+        }
+        if (log_level > LOG_FINAL && now_seconds() >= next_print && exchange_copy(exchange, path, &len)
+                && (printed == LLONG_MAX || log_level == LOG_EVERY || printed - len >= LOG_MIN_GAIN)) {
+            print_path(path, len);
+            printed = len;
+            next_print = now_seconds() + log_gap_ms / 1000.0;
+        }
+    }
+    len = LLONG_MAX;
+    if (!exchange_copy(exchange, path, &len)) {
+        printf("NO WORKER FOUND A PATH.\n");
+        exit(EXIT_FAILURE);
+    }
+    print_path(path, len);
+    free(path);
+    free(pids);
+    exchange_free(exchange);
+    exchange = NULL;
+}
+
+/**
+ * Gives every NUMA node its own copy of the distance matrix, each made by
+ * a thread running on that node so its pages end up there.
+ */
+void build_replicas() {
+    if (dists.layout == DIST_COMPUTED) {
+        fprintf(stderr, "Distances are computed, so there is nothing to replicate\n");
+        return;
+    }
+    num_replicas = numa_node_count();
+    replicas = (struct dist_matrix *) malloc(num_replicas * sizeof(struct dist_matrix));
+    pthread_t *t = (pthread_t *) malloc(num_replicas * sizeof(pthread_t));
+    int *nodes = (int *) malloc(num_replicas * sizeof(int)), i;
+    for (i = 0; i < num_replicas; i++) {
+        nodes[i] = i;
+        pthread_create(&t[i], NULL, build_replica, &nodes[i]);
+    }
+    for (i = 0; i < num_replicas; i++) {
+        pthread_join(t[i], NULL);
+    }
+    fprintf(stderr, "Distances: a copy on each of %d NUMA nodes\n", num_replicas);
+    free(t);
+    free(nodes);
+}
+
+/**
+ * Thread function for build_replicas.
+ * @param node Pointer to the node to make a copy on
+ */
+void* build_replica(void *node) {
+    int n = *(int *) node;
+    if (!numa_bind_node(n)) {
+        fprintf(stderr, "Could not run on NUMA node %d, its copy may be elsewhere\n", n);
+    }
+    dist_matrix_copy(&replicas[n], &dists);
+    return NULL;
+}
+
+/**
+ * Prints where every thread ran to stderr.
+ */
+void report_places() {
+    int i;
+    for (i = 0; i < num_threads; i++) {
+        struct thread_place *p = &places[i];
+        fprintf(stderr, "Thread %d: ", i);
+        if (p->cpu >= 0) {
+            fprintf(stderr, "pinned to CPU %d, ", p->cpu);
+        }
+        fprintf(stderr, "ran on CPU %d", p->start_cpu);
+        if (p->end_cpu != p->start_cpu) {
+            fprintf(stderr, " then %d", p->end_cpu);
+        }
+        fprintf(stderr, ", NUMA node %d", p->node);
+        if (replicas != NULL) {
+            fprintf(stderr, ", distances from node %d",
+                    p->node < num_replicas ? p->node : 0);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+/**
+ * Trades best paths with the other worker processes: this process's best
+ * path goes to the exchange if it's better, and the exchanged path goes to
+ * every island if it's better. Only call from the main thread while solve
+ * runs.
+ * @param path Room for a path, overwritten
+ */
+void sync_exchange(int path[]) {
+    long long len = islands_best_len(), shared = exchange_len(exchange);
+    if (len < shared) {
+        len = islands_copy_best(path);
+        exchange_publish(exchange, path, len);
+    } else if (shared < len && exchange_copy(exchange, path, &len)) {
+        islands_offer(path, len);
+    }
+}
+
+/**
+ * Records the best length at the given time for the anytime curve, if it
+ * changed since the last sample.
+ */
+void add_sample(struct run_stats *stats, double seconds, long long len) {
+    if (stats->samples > 0 && stats->lens[stats->samples - 1] == len) {
+        return;
+    }
+    if (stats->samples == stats->capacity) {
+        stats->capacity = stats->capacity > 0 ? stats->capacity * 2 : 64;
+        stats->times = (double *) realloc(stats->times, stats->capacity * sizeof(double));
+        stats->lens = (long long *) realloc(stats->lens, stats->capacity * sizeof(long long));
+    }
+    stats->times[stats->samples] = seconds;
+    stats->lens[stats->samples] = len;
+    stats->samples++;
 }
 
 /**
  * Function for the threads to execute the hill climbing algorithm
- * for finding an OK traveling salesman path
+ * for finding an OK traveling salesman path.
+ * Every node whose don't-look bit is off is handed to the move types
+ * until none of them can improve the path. After that, random swaps are
+ * tried until num_tries of them have failed in a row, or until the
+ * threads are told to stop.
+ * The best path is shared with the other threads on the same island.
+ * @param t Pointer to the thread's index, which picks its random stream
+ *          and island
  */
 void* thread_hill_climb(void* t) {
+    int id = *(int *) t;
+    // Move to this thread's CPU first, so everything it allocates is put
+    // on that CPU's node, and read the distances from the same node
+    struct thread_place *place = &places[id];
+    place->cpu = -1;
+    if (num_place_cpus > 0) {
+        place->cpu = place_cpus[id % num_place_cpus];
+        if (!numa_bind_cpu(place->cpu)) {
+            fprintf(stderr, "Thread %d could not be pinned to CPU %d\n", id, place->cpu);
+            place->cpu = -1;
+        }
+    }
+    place->start_cpu = numa_current_cpu();
+    place->node = replicas != NULL || num_place_cpus > 0 ? numa_cpu_node(place->start_cpu) : 0;
+    if (replicas != NULL) {
+        thread_dists = &replicas[place->node < num_replicas ? place->node : 0];
+    }
+    struct island *island = island_of(id);
+    struct counters *c = &counters[id];
     // The local length and path of this thread
-    int plen = min_len + 1; // so that distance is > min_distance
-    int path[num_nodes];
+    struct search s;
+    struct best_reader reader;
+    search_init(&s, num_nodes, tour_layout);
+    load_rng(&saved_rngs[id], &s.rng); // seeded by solve
+    int saved = 0; // the last checkpoint request this thread saved for
+    best_reader_init(&reader, &island->best, island_slot(id));
+    s.len = best_len(&island->best) + 1; // so that distance is > min_distance
+    if (num_starts > 1 && resume_file == NULL) {
+        // Start from this thread's own path instead of the shared one
+        starts[id % num_starts]->build(s.tour.path, &s.rng);
+        tour_update_pos(&s.tour);
+        s.len = find_path_len(s.tour.path);
+        search_wake_all(&s);
+        compare_and_update_bpath(&reader, c, &s.tour, s.len);
+    }
     
-    int r1, r2, trycount;
-    for (trycount = 0; trycount < NUM_TRIES; trycount++) 
+    // The policy for random swaps, started from the best length known
+    struct acceptor acc;
+    const struct accept_policy *policy = &policies[id % num_policies];
+    long long known = LLONG_MAX; // island's best at the last look, so the first look copies
+    long long start_len = best_len(&island->best);
+    acceptor_init(&acc, policy, s.len < start_len ? s.len : start_len, num_nodes);
+    
+    int r1, r2, i, node, trycount;
+    long long delta, offer_at = 0;
+    // The move code made for this thread's kind of distances, see dist.h
+    enum dist_kind kind = dist_kind_of(thread_dists);
+    long long (*improve[MAX_MOVES])(struct search *s, int node);
+    long long (*swap)(const struct tour *t, int a, int b) = swap_deltas[kind];
+    for (i = 0; i < num_moves; i++) {
+        improve[i] = moves[i]->improve[kind];
+    }
+    for (trycount = 0; (num_tries == 0 || trycount < num_tries)
+            && !atomic_load_explicit(&stop_search, memory_order_relaxed);) 
     {
+        int request = atomic_load_explicit(&checkpoint_request, memory_order_relaxed);
+        if (request != saved) {
+            save_rng(&saved_rngs[id], &s.rng, request);
+            saved = request;
+        }
+        
         // Check to see if the global solution is better than the 
         // local solution. If it is, the global solution will be
-        // copied.
-        if (min_len < plen && compare_and_copy_bpath(path, &plen)) {
+        // copied. A thread that takes uphill swaps is usually behind the
+        // best on purpose, so it only copies when the best improves.
+        long long island_len = best_len(&island->best);
+        int copy = island_len < s.len && (policy->kind == ACCEPT_STRICT || island_len < known);
+        known = island_len;
+        if (copy && compare_and_copy_bpath(&reader, c, s.tour.path, &s.len)) {
             // local path was updated with the best path
+            tour_update_pos(&s.tour);
+            search_wake_all(&s);
             trycount = 0;
         }
         
-        // Pick two random indices. Store in r1, r2
-        r1 = rand_int(num_nodes);
-        r2 = rand_int(num_nodes-1);
+        node = search_next(&s);
+        if (node != -1) {
+            // Try each move type around the node until one works
+            for (i = 0; i < num_moves; i++) {
+                delta = improve[i](&s, node);
+                counter_add(&c->moves, 1);
+                if (delta < 0) {
+                    counter_add(&c->accepts, 1);
+                    s.len += delta;
+                    offer_path(&reader, c, &s.tour, s.len, &offer_at);
+                    break;
+                }
+            }
+            continue;
+        }
+        
+        // No move type can improve the path anymore. Anything offer_path
+        // held back goes out now.
+        compare_and_update_bpath(&reader, c, &s.tour, s.len);
+        // Fall back to switching random nodes.
+        trycount++;
+        
+        // Pick two random nodes. Store in r1, r2
+        r1 = rng_int(&s.rng, num_nodes);
+        r2 = rng_int(&s.rng, num_nodes-1);
         r2 += r2 >= r1; // Shift r2's distribution so that r2 != r1
         
-        // Switch the two and see if it makes the path better
-        switch_pvalues(path, r1, r2);
-        int newplen = find_path_len(path);
+        // See if switching the two makes the path better. Only the edges
+        // next to r1 and r2 change, so there's no need to walk the path.
+        delta = swap(&s.tour, r1, r2);
+        counter_add(&c->moves, 1);
+        counter_add(&c->swaps, 1);
         
-        // Check to see if the new length is better
-        if (newplen < plen) {
-            // If so then update the global path with the current path
-            // only if the newplen is better
-            compare_and_update_bpath(path, newplen);
+        // Commit the switch if the new length is better, or if the
+        // acceptance policy takes it anyway
+        if (acceptor_take(&acc, &s.rng, s.len, delta)) {
+            if (delta < 0) {
+                counter_add(&c->accepts, 1);
+            } else if (delta > 0) {
+                trycount = 0; // a step uphill isn't a failed try
+            }
+            tour_swap(&s.tour, r1, r2);
+            s.len += delta;
+            // The edges around both nodes changed, so look at them again
+            search_wake(&s, r1);
+            search_wake(&s, r2);
+            search_wake(&s, tour_prev(&s.tour, r1));
+            search_wake(&s, tour_next(&s.tour, r1));
+            search_wake(&s, tour_prev(&s.tour, r2));
+            search_wake(&s, tour_next(&s.tour, r2));
+            // Update the global path with the current path
+            // only if the new plen is better
+            offer_path(&reader, c, &s.tour, s.len, &offer_at);
             // if this "better path" is worse than another best path found,
             // the next iteration will copy the new best path
         }
-        // The new length is worse...
-        else {
-            // Undo the swap
-            switch_pvalues(path, r1, r2);
-        }
     }
+    compare_and_update_bpath(&reader, c, &s.tour, s.len);
+    acceptor_free(&acc);
+    save_rng(&saved_rngs[id], &s.rng, RNG_FINAL);
+    place->end_cpu = numa_current_cpu();
+    best_reader_free(&reader);
+    search_free(&s);
+    atomic_fetch_sub(&island->running, 1);
     pthread_exit(NULL);
 }
 
-
-/*
- * Reads the local file "cities.txt" which should be filled with integers
- * which represent a series of x and y values for nodes.
- * This method will initialize 'num_nodes' and 'dists'.
- * If "cities.txt" is not found this method will cause core dump :(.
+/**
+ * Reads the command line options, then the optional file name (default
+ * FILE_NAME):
+ *    -m list: comma separated move types to use, in order (default 2opt,oropt)
+ *    -b list: comma separated starting path builders. Thread t builds its
+ *             own with the (t % count)'th one if there's more than one;
+ *             otherwise every thread starts from the same path.
+ *             (default random)
+ *    -A list: comma separated acceptance policies for random swaps, one
+ *             per thread in turn, see accept.h (default strict)
+ *    -k count: length of the candidate neighbor lists (default 10)
+ *    -s seed: master random seed (default picked from the time and pid)
+ *    -t count: number of threads (default NUM_THREADS)
+ *    -w width: distance entry width, auto, 16, 32 or float (default auto)
+ *    -p: store only the upper triangle of the distance matrix
+ *    -c: compute distances when needed instead of storing a matrix. This is
+ *        the default above MATRIX_NODE_LIMIT nodes.
+ *    -l layout: how tours are stored, auto, array or list (default auto,
+ *        list above TOUR_LIST_NODE_LIMIT nodes)
+ *    -i count: number of islands (default 1)
+ *    -T topology: where migrants go, ring or all (default ring)
+ *    -e ms: time between migrations (default DEFAULT_MIGRATION_MS)
+ *    -r ms: print the threads' counters every ms milliseconds, and each
+ *           thread's totals at the end (default off). See counters.h.
+ *    -L seconds: stop the threads after this much wall time (default none)
+ *    -U seconds: stop the threads after this much CPU time, all threads
+ *                together (default none)
+ *    -n tries: failed random swaps in a row before a thread stops, 0 for
+ *              no limit (default NUM_TRIES)
+ *    -o file: write checkpoints to file, see checkpoint.h (default none)
+ *    -O seconds: time between checkpoints (default 60)
+ *    -R file: start every thread from the checkpoint in file
+ *    -P count: solve with this many worker processes of -t threads each,
+ *              sharing the distance matrix and best path (default 1)
+ *    -N: bind worker process w to NUMA node w % nodes
+ *    -a policy: pin the threads to CPUs: compact, scatter or a CPU list,
+ *               see numa.h (default none)
+ *    -M: give every NUMA node its own copy of the distance matrix
+ *    -v level: which paths to print, 0 for only the final one, 1 for the
+ *              starting one and big improvements, 2 for every improvement
+ *              (default 1). See log.h.
+ *    -g ms: least time between printed paths (default 0)
+ *    -B prefix: run the benchmarks and write the results to prefix.csv,
+ *               prefix_curve.csv and prefix.json. See bench.h.
  */
-void init_dists() {
-    // I use i and j a lot so I'll initialize them here
-    int i, j;
-    
-    // Redirect input
-    int file_id = open(FILE_NAME, O_RDONLY, 0666);
-    if (file_id == -1) {
-        printf("FILE '%s' NOT FOUND.\n", FILE_NAME);
+void parse_args(int argc, char *argv[]) {
+    char default_moves[] = DEFAULT_MOVES;
+    char *move_list = default_moves;
+    char default_builders[] = DEFAULT_BUILDERS;
+    char *builder_list = default_builders;
+    char default_policies[] = DEFAULT_POLICIES;
+    char *policy_list = default_policies;
+    int opt;
+    seed = (uint64_t) time(NULL) * 1000003 + getpid();
+    while ((opt = getopt(argc, argv, "m:b:A:k:s:t:w:pcl:i:T:e:r:L:U:n:o:O:R:P:Na:Mv:g:B:")) != -1) {
+        switch (opt) {
+            case 'm':
+                move_list = optarg;
+                break;
+            case 'b':
+                builder_list = optarg;
+                break;
+            case 'A':
+                policy_list = optarg;
+                break;
+            case 'k':
+                neighbor_count = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            case 't':
+                num_threads = atoi(optarg);
+                if (num_threads < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'w':
+                if (strcmp(optarg, "auto") == 0) {
+                    dist_width = DIST_AUTO;
+                } else if (strcmp(optarg, "16") == 0) {
+                    dist_width = DIST_U16;
+                } else if (strcmp(optarg, "32") == 0) {
+                    dist_width = DIST_U32;
+                } else if (strcmp(optarg, "float") == 0) {
+                    dist_width = DIST_FLOAT;
+                } else {
+                    usage(argv[0]);
+                }
+                break;
+            case 'p':
+                dist_layout = DIST_PACKED;
+                dist_layout_given = 1;
+                break;
+            case 'c':
+                dist_layout = DIST_COMPUTED;
+                dist_layout_given = 1;
+                break;
+            case 'l':
+                if (strcmp(optarg, "auto") == 0) {
+                    tour_layout_given = 0;
+                } else if (strcmp(optarg, "array") == 0) {
+                    tour_layout = TOUR_ARRAY;
+                    tour_layout_given = 1;
+                } else if (strcmp(optarg, "list") == 0) {
+                    tour_layout = TOUR_LIST;
+                    tour_layout_given = 1;
+                } else {
+                    usage(argv[0]);
+                }
+                break;
+            case 'i':
+                island_count = atoi(optarg);
+                break;
+            case 'T':
+                if (strcmp(optarg, "ring") == 0) {
+                    topology = TOPOLOGY_RING;
+                } else if (strcmp(optarg, "all") == 0) {
+                    topology = TOPOLOGY_ALL;
+                } else {
+                    usage(argv[0]);
+                }
+                break;
+            case 'e':
+                migration_ms = atoi(optarg);
+                if (migration_ms < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'r':
+                report_ms = atoi(optarg);
+                if (report_ms < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'L':
+                time_limit = atof(optarg);
+                break;
+            case 'U':
+                cpu_limit = atof(optarg);
+                break;
+            case 'n':
+                num_tries = atoi(optarg);
+                if (num_tries < 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'o':
+                checkpoint_file = optarg;
+                break;
+            case 'O':
+                checkpoint_seconds = atof(optarg);
+                if (checkpoint_seconds <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'R':
+                resume_file = optarg;
+                break;
+            case 'P':
+                num_procs = atoi(optarg);
+                if (num_procs < 1) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'N':
+                pin_workers = 1;
+                break;
+            case 'a':
+                placement = optarg;
+                break;
+            case 'M':
+                replicate = 1;
+                break;
+            case 'v':
+                if (atoi(optarg) < LOG_FINAL || atoi(optarg) > LOG_EVERY) {
+                    usage(argv[0]);
+                }
+                log_level = (enum log_level) atoi(optarg);
+                break;
+            case 'g':
+                log_gap_ms = atoi(optarg);
+                break;
+            case 'B':
+                bench_prefix = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (optind < argc) {
+        file_name = argv[optind];
+    }
+    if (island_count < 1 || island_count > num_threads) {
+        printf("THE NUMBER OF ISLANDS MUST BE BETWEEN 1 AND THE NUMBER OF THREADS.\n");
         exit(EXIT_FAILURE);
     }
-    close(0);
-    dup(file_id);
-    close(file_id);
-    
-    // Declare the number of nodes to be 0
-    num_nodes = 0;
-    
-    // Used as a low level stack to store all input from the file
-    struct stack_node {
-        struct stack_node *next;
-        int x;
-        int y;
-    };
-    struct stack_node *stack_head = NULL; // head node of the stack
-    
-    // temp variables
-    int temp_xval=0, temp_yval=0;
-    int success = 1;
-    while(success)
-    {
-        // Get the next two numbers from the file and use them as the
-        // x, y values of the next node. If There are no more numbers in the 
-        // file or if the count of numbers in the file is odd, success will be
-        // false. Otherwise success is true.
-        success = scanf("%d", &temp_xval) >= 0;
-        success &= scanf("%d", &temp_yval) >= 0;
-        
-        // We've loaded two values from the file so add them to the stack
-        if (success)
-        {
-            // Declare the next node
-            struct stack_node *next_node = (struct stack_node *) malloc(sizeof(struct stack_node));
-            next_node->x = temp_xval;
-            next_node->y = temp_yval;
-            next_node->next = stack_head;
-            stack_head = next_node;
-            num_nodes++;
+    if (num_procs > 1 && (checkpoint_file != NULL || resume_file != NULL)) {
+        printf("CHECKPOINTS CAN'T BE USED WITH WORKER PROCESSES.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (placement != NULL) {
+        place_cpus = (int *) malloc(num_threads * sizeof(int));
+        num_place_cpus = numa_placement(placement, place_cpus, num_threads);
+        if (num_place_cpus < 1) {
+            printf("UNKNOWN THREAD PLACEMENT '%s'.\n", placement);
+            exit(EXIT_FAILURE);
         }
     }
-    
-    // Initialize an array to store all of the x,y values from the stack
-    // so I can use random access.
-    int nodevals[num_nodes*2];
-    struct stack_node *temp_node = NULL; 
-    
-    // Go through the stack and store the values into an array,
-    // pop, and deallocate
-    for(i = 2*num_nodes-1; stack_head != NULL; i-=2)
-    {
-        nodevals[i-1] = stack_head->x;
-        nodevals[i] = stack_head->y;
-        temp_node = stack_head->next;
-        free(stack_head);
-        stack_head = temp_node;
+    parse_moves(move_list);
+    parse_builders(builder_list);
+    parse_policies(policy_list);
+}
+
+/**
+ * Fills 'moves' from a comma separated list of move type names.
+ */
+void parse_moves(char *list) {
+    char *name;
+    num_moves = 0;
+    for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        const struct move_type *type = find_move_type(name);
+        if (type == NULL) {
+            printf("UNKNOWN MOVE TYPE '%s'.\n", name);
+            exit(EXIT_FAILURE);
+        }
+        if (num_moves < MAX_MOVES) {
+            moves[num_moves++] = type;
+        }
     }
-    
-    // Allocate memory for 2D distances array of size num_nodes x num_nodes.
-    dists = (int **) malloc(num_nodes * sizeof(int *));
-    
-    for(i = 0; i < num_nodes; i++)
-    {
-        dists[i] = (int *) malloc(num_nodes * sizeof(int));
+}
+
+/**
+ * Fills 'starts' from a comma separated list of builder names.
+ */
+void parse_builders(char *list) {
+    char *name;
+    num_starts = 0;
+    for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        const struct builder *b = find_builder(name);
+        if (b == NULL) {
+            printf("UNKNOWN STARTING PATH BUILDER '%s'.\n", name);
+            exit(EXIT_FAILURE);
+        }
+        if (num_starts < MAX_BUILDERS) {
+            starts[num_starts++] = b;
+        }
+    }
+    if (num_starts == 0) {
+        printf("NO STARTING PATH BUILDER GIVEN.\n");
+        exit(EXIT_FAILURE);
     }
+}
 
-    // Calculate the distance between every combination of two cities.
-    for (i = 0; i < num_nodes; i++) {
-        for (j = 0; j < num_nodes; j++) {
-            int dx = nodevals[i*2] - nodevals[j*2];
-            int dy = nodevals[i*2+1] - nodevals[j*2+1];
-            dists[i][j] = (int)sqrt((float)(dx*dx + dy*dy));
+/**
+ * Fills 'policies' from a comma separated list of acceptance policies,
+ * see accept_parse.
+ */
+void parse_policies(char *list) {
+    char *spec;
+    num_policies = 0;
+    for (spec = strtok(list, ","); spec != NULL; spec = strtok(NULL, ",")) {
+        struct accept_policy p;
+        if (!accept_parse(spec, &p)) {
+            printf("UNKNOWN ACCEPTANCE POLICY '%s'.\n", spec);
+            exit(EXIT_FAILURE);
         }
+        if (num_policies < MAX_POLICIES) {
+            policies[num_policies++] = p;
+        }
+    }
+    if (num_policies == 0) {
+        printf("NO ACCEPTANCE POLICY GIVEN.\n");
+        exit(EXIT_FAILURE);
     }
 }
+
 /**
- * Initialize the min_path variable with a random starting path 
- * for the round trip. Also calculates and assigns the length for that
- * path into min_length.
+ * Prints the command line options and exits.
  */
-void init_path() {
-    // Allocate min_path to the appropriate size
-    min_path = (int *) malloc(num_nodes * sizeof(int));
-    
-    // Assign a random starting path
-    
-    int rand_path_help[num_nodes]; // used to mark which nodes have been traveled to
-    int i, j, nodes_left = num_nodes, temp;
-    
-    // Say that no paths have been traveled to
-    for(i = 0; i < num_nodes; i++) {
-        rand_path_help[i] = 0;
+void usage(char *name) {
+    int i;
+    printf("Usage: %s [-m moves] [-b builders] [-A policies] [-k neighbors] [-s seed]\n"
+           "       [-t threads] [-w width] [-p | -c] [-l layout] [-i islands] [-T topology] [-e ms] [-r ms]\n"
+           "       [-L seconds] [-U seconds] [-n tries] [-o file] [-O seconds]\n"
+           "       [-R file] [-P procs] [-N] [-a policy] [-M] [-v level] [-g ms]\n"
+           "       [-B prefix] [file]\n", name);
+    printf("  -m  comma separated move types, tried in order. Default: %s\n", DEFAULT_MOVES);
+    printf("      Available:");
+    for (i = 0; i < num_move_types; i++) {
+        printf(" %s", move_types[i].name);
     }
-    
-    // Go through each index of the min_path and assign a random node to travel to
-    for(i = 0; i < num_nodes; i++)
-    {
-        temp = rand_int(nodes_left) + 1;
-        // find the temp'th node that has not been traveled to
-        for(j = 0; temp > 0 && j < num_nodes; j++)
-        {
-            if (rand_path_help[j] == 0) {
-                temp--;
+    printf("\n  -b  comma separated starting path builders, one per thread in turn. Default: %s\n",
+           DEFAULT_BUILDERS);
+    printf("      Available:");
+    for (i = 0; i < num_builders; i++) {
+        printf(" %s", builders[i].name);
+    }
+    printf("\n  -A  comma separated acceptance policies for random swaps, one per thread in turn.\n"
+           "      Default: %s\n", DEFAULT_POLICIES);
+    printf("      Available: strict anneal[:T:alpha] adaptive[:T:alpha] late[:length]\n"
+           "      threshold[:T:alpha]\n");
+    printf("  -k  candidate neighbors per node. Default: %d\n", DEFAULT_NEIGHBORS);
+    printf("  -s  master random seed. Default: picked from the time and pid\n");
+    printf("  -t  number of threads. Default: %d\n", NUM_THREADS);
+    printf("  -w  distance entry width: auto, 16, 32 or float. Default: auto\n");
+    printf("  -p  only store the upper triangle of the distance matrix\n");
+    printf("  -c  compute distances when needed. Default above %d nodes\n", MATRIX_NODE_LIMIT);
+    printf("  -l  tour layout: auto, array or two-level list. Default: list above %d nodes\n",
+           TOUR_LIST_NODE_LIMIT);
+    printf("  -i  number of islands, each with its own best path. Default: 1\n");
+    printf("  -T  migration topology: ring or all. Default: ring\n");
+    printf("  -e  milliseconds between migrations. Default: %d\n", DEFAULT_MIGRATION_MS);
+    printf("  -r  milliseconds between live counter reports, with per-thread totals at the end\n");
+    printf("  -L  wall clock seconds before the threads stop. Default: no limit\n");
+    printf("  -U  CPU seconds (all threads) before the threads stop. Default: no limit\n");
+    printf("  -n  failed random swaps in a row before a thread stops, 0 for no limit. Default: %d\n",
+           NUM_TRIES);
+    printf("  -o  file to write checkpoints of the best path and generators to\n");
+    printf("  -O  seconds between checkpoints. Default: %d\n", DEFAULT_CHECKPOINT_SECONDS);
+    printf("  -R  checkpoint file to resume from\n");
+    printf("  -P  worker processes, each with -t threads, sharing distances and the best path\n");
+    printf("  -N  bind each worker process to a NUMA node in turn\n");
+    printf("  -a  pin threads to CPUs: compact, scatter or a CPU list like 0-3,8\n");
+    printf("  -M  give every NUMA node its own copy of the distance matrix\n");
+    printf("  -v  paths printed: 0 final only, 1 big improvements, 2 every improvement. Default: 1\n");
+    printf("  -g  least milliseconds between printed paths. Default: 0\n");
+    printf("  -B  run the benchmarks, writing prefix.csv, prefix_curve.csv and prefix.json\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * Returns the time in seconds from an arbitrary starting point.
+ */
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Returns the CPU time used by every thread of the process in seconds.
+ */
+double cpu_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Signal handler for SIGINT and SIGTERM: tells every thread to stop.
+ */
+void stop_handler(int sig) {
+    (void) sig;
+    atomic_store(&stop_search, 1);
+}
+
+/**
+ * Saves a thread's generator so the main thread can checkpoint it.
+ * @param request The checkpoint request it's saved for, or RNG_FINAL if
+ *                the thread won't use it anymore
+ */
+void save_rng(struct saved_rng *slot, const struct rng *rng, int request) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        atomic_store_explicit(&slot->s[i], rng->s[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->request, request, memory_order_release);
+}
+
+/**
+ * Reads the generator last saved in slot.
+ */
+void load_rng(struct saved_rng *slot, struct rng *rng) {
+    int i;
+    atomic_load_explicit(&slot->request, memory_order_acquire);
+    for (i = 0; i < 4; i++) {
+        rng->s[i] = atomic_load_explicit(&slot->s[i], memory_order_relaxed);
+    }
+}
+
+/**
+ * Writes the best path so far and every thread's generator to
+ * checkpoint_file. The threads are asked to save their generators first
+ * and given up to CHECKPOINT_WAIT_MS to do it; a thread that's busy for
+ * longer is checkpointed with the generator it saved last time.
+ * Only call from the main thread while solve runs.
+ * @param elapsed Seconds since the threads started
+ */
+void write_checkpoint(double elapsed) {
+    int request = atomic_fetch_add(&checkpoint_request, 1) + 1, i, wait;
+    for (wait = 0; wait < CHECKPOINT_WAIT_MS; wait++) {
+        for (i = 0; i < num_threads; i++) {
+            int r = atomic_load_explicit(&saved_rngs[i].request, memory_order_acquire);
+            if (r != request && r != RNG_FINAL) {
+                break;
             }
         }
-        // the loop above must execute at least once since temp will have
-        // a minimum value of 1. So 1 <= j <= num_nodes.
-        
-        rand_path_help[j-1] = 1; // mark the j-1'th node as traveled to
-        min_path[i] = j-1; // travel to that node next
-        nodes_left--;
+        if (i == num_threads) {
+            break;
+        }
+        sleep_ms(1);
+    }
+
+    struct checkpoint cp;
+    cp.n = num_nodes;
+    cp.seed = seed;
+    cp.elapsed = elapsed + (resume_file != NULL ? resume.elapsed : 0);
+    cp.threads = num_threads;
+    cp.rngs = (struct rng *) malloc(num_threads * sizeof(struct rng));
+    cp.path = (int *) malloc(num_nodes * sizeof(int));
+    for (i = 0; i < num_threads; i++) {
+        load_rng(&saved_rngs[i], &cp.rngs[i]);
+    }
+    cp.len = islands_copy_best(cp.path);
+    checkpoint_write(checkpoint_file, &cp);
+    free(cp.rngs);
+    free(cp.path);
+}
+
+/**
+ * Sleeps for the given number of milliseconds.
+ */
+void sleep_ms(int ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+/*
+ * Reads the given file of node locations, either plain x and y values
+ * (like "cities.txt") or a TSPLIB .tsp file. See load.h.
+ * This method will initialize 'num_nodes', 'coords' and 'dists'.
+ * If the file can't be read this method will exit.
+ */
+void init_dists() {
+    struct cities cities;
+    load_cities(file_name, &cities);
+    num_nodes = cities.n;
+    coords = cities.coords;
+    if (num_nodes < 2) {
+        printf("FILE '%s' NEEDS AT LEAST 2 NODES.\n", file_name);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "Loaded %d nodes from %s (%s)\n", num_nodes, file_name,
+            dist_metric_name(cities.metric));
+    
+    // Calculate the distance between every combination of two cities,
+    // unless there are too many for the matrix to fit in memory.
+    if (!dist_layout_given && num_nodes > MATRIX_NODE_LIMIT) {
+        dist_layout = DIST_COMPUTED;
+    }
+    if (num_procs > 1) {
+        // One copy for every worker process
+        dist_matrix_build_shared(&dists, num_nodes, coords, cities.weights, cities.metric,
+                dist_layout, dist_width);
+    } else {
+        dist_matrix_build(&dists, num_nodes, coords, cities.weights, cities.metric,
+                dist_layout, dist_width);
+    }
+    free(cities.weights); // copied into the matrix
+    if (dists.layout == DIST_COMPUTED) {
+        fprintf(stderr, "Distances: %d nodes, computed on the fly\n", num_nodes);
+    } else {
+        fprintf(stderr, "Distances: %d nodes, %s %s matrix, %zu bytes, built with %s\n",
+                num_nodes, dist_layout_name(dists.layout), dist_width_name(dists.width),
+                dists.bytes, simd_level_name(simd_level()));
+    }
+}
+/**
+ * Initialize the min_path variable with a starting path for the round trip,
+ * built with the first of the starting path builders or taken from the
+ * checkpoint being resumed. Also calculates and
+ * assigns the length for that path into min_length.
+ */
+void init_path() {
+    min_path = (int *) malloc(num_nodes * sizeof(int));
+    if (resume_file != NULL) {
+        memcpy(min_path, resume.path, num_nodes * sizeof(int));
+    } else {
+        struct rng rng;
+        rng_seed(&rng, seed, stream_base);
+        starts[0]->build(min_path, &rng);
     }
     
     // Assign the length
     min_len = find_path_len(min_path);
-    last_len = min_len;
+    if (resume_file != NULL && min_len != resume.len) {
+        printf("CHECKPOINT '%s' IS FOR DIFFERENT NODES.\n", resume_file);
+        exit(EXIT_FAILURE);
+    }
 }
 
 /**
- * Will compare the global path length (min_len) with the given length.
+ * Will compare the best path's length with the given length.
  * If the given length is higher (worse), the given path is updated
- * with the global path and the given length (by reference) is updated to be
- * min_len. This method uses a mutex to make it synchronized. 
- * @param path The path to override if length is greater than min_len
+ * with the best path and the given length (by reference) is updated to be
+ * the best length. This method never blocks, see best.h.
+ * @param r The calling thread's best path state
+ * @param c The calling thread's counters
+ * @param path The path to override if length is greater than the best length
  * @param length The length of the given path.
  * @return 1 if the given path was overridden. Otherwise 0.
  */
-int compare_and_copy_bpath(int path[], int *length) {
-    int flag_success = 0;
-    pthread_mutex_lock(&mutex);
-    if (min_len < *length) {
-        int i;
-        for (i = 0; i < num_nodes; i++) {
-            path[i] = min_path[i];
-        }
-        *length = min_len;
-        flag_success = 1;
-    }
-    pthread_mutex_unlock(&mutex);
-    return flag_success;
+int compare_and_copy_bpath(struct best_reader *r, struct counters *c, int path[], long long *length) {
+    long long start = counters_now_ns();
+    int copied = best_copy(r, path, length);
+    counter_add(&c->sync_ns, counters_now_ns() - start);
+    counter_add(&c->copies, copied);
+    return copied;
 }
 
 /**
- * Will compare the global path length (min_len) with the given length.
- * If the given length is lower (better), the given path is copied
- * to be the global path and the given length (by reference) is copied to be
- * min_len. This method uses a mutex to make it synchronized. 
- * @param path The path to copy if it's better than the global version
+ * Will compare the best path's length with the given length.
+ * If the given length is lower (better), the given path is published
+ * as the new best path. This method never blocks, see best.h.
+ * @param r The calling thread's best path state
+ * @param c The calling thread's counters
+ * @param t The tour to copy if it's better than the best path
  * @param length The length of the given path.
  */
-void compare_and_update_bpath(int path[], int length) {
-    pthread_mutex_lock(&mutex);
-    if (length < min_len) {
-        int i;
-        for (i = 0; i < num_nodes; i++) {
-            min_path[i] = path[i];
-        }
-        // Just to be safe, instead of using the given length.
-        min_len = find_path_len(min_path);
-        
-        // Print the path if there has been 'significant' improvement
-        if (last_len - min_len >= 1000)
-        {
-            last_len = min_len;
-            print_path(min_path, min_len);
-        }
+void compare_and_update_bpath(struct best_reader *r, struct counters *c, struct tour *t, long long length) {
+    if (length >= best_len(r->shared)) {
+        return; // not worth timing
     }
-    pthread_mutex_unlock(&mutex);
+    long long start = counters_now_ns();
+    int *path = tour_path(t);
+    int published = best_publish(r, path, length);
+    counter_add(&c->sync_ns, counters_now_ns() - start);
+    counter_add(&c->publishes, published);
 }
 
 /**
- * Will generate and return a random integer in the range [0, n)
+ * compare_and_update_bpath for a thread that just improved its tour.
+ * Reading a list tour out takes O(n) steps, which is a lot more than the
+ * moves themselves, so list tours are offered at most every LIST_OFFER_NS.
+ * The thread offers its tour again once it runs out of moves and before it
+ * stops, so nothing held back is lost.
+ * @param offer_at When the next list tour can be offered. Start at 0.
  */
-int rand_int(int n) {
-    return rand() % n;
+void offer_path(struct best_reader *r, struct counters *c, struct tour *t, long long length,
+                long long *offer_at) {
+    if (t->layout == TOUR_LIST) {
+        long long now = counters_now_ns();
+        if (now < *offer_at) {
+            return;
+        }
+        *offer_at = now + LIST_OFFER_NS;
+    }
+    compare_and_update_bpath(r, c, t, length);
 }
 
 /**
- * Helper method. Prints the length and path given.
+ * Helper method. Prints the length and path given, see log_write_path.
  */
-void print_path(int path[], int length) {
-    printf("%d.", length);
-    int i;
-    for (i = 0; i < num_nodes; i++) {
-        printf(" %d", path[i]);
-    }
-    printf("\n");
+void print_path(int path[], long long length) {
+    log_write_path(stdout, path, num_nodes, length);
 }
 
 /**
@@ -332,26 +1258,6 @@ void print_path(int path[], int length) {
  * @param path The path to find the length of
  * @return The length of the given path
  */
-int find_path_len(int path[]) {
-    int sum = 0, a, b, i;
-    for (i = 0; i < num_nodes; i++) {
-        a = path[i];
-        b = path[(i + 1) % num_nodes];
-        sum += dists[a][b];
-    }
-    return sum;
-}
-
-/**
- * Helper method for switching the values of path at the given indexes.
- * So the values at path[index1] and path[index2] are switched.
- * @param path The path to switch values in
- * @param index1 The index of the first value to switch
- * @param index2 The index of the second value to switch
- */
-void switch_pvalues(int path[], int index1, int index2)
-{
-    int temp = path[index1];
-    path[index1]=path[index2];
-    path[index2]=temp;
+long long find_path_len(int path[]) {
+    return simd_path_len(simd_level(), thread_dists, path);
 }
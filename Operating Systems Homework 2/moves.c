@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+#include "tsp.h"
+#include "neighbors.h"
+#include "moves.h"
+
+#define MAX_SEGMENT 3 // longest segment moved by Or-opt
+// Most moves the batch move type finds per candidate neighbor: a 2-opt
+// move each way, and an Or-opt move on either side of the neighbor for
+// each segment (MAX_SEGMENT going forward, MAX_SEGMENT - 1 going back)
+#define BATCH_PER_NEIGHBOR (2 + 2 * (2 * MAX_SEGMENT - 1))
+
+/**
+ * Returns the move type with the given name, or NULL if there is none.
+ */
+const struct move_type *find_move_type(const char *name) {
+    int i;
+    for (i = 0; i < num_move_types; i++) {
+        if (strcmp(move_types[i].name, name) == 0) {
+            return &move_types[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Allocates the local state for a thread searching paths of n nodes, with
+ * its tour in the given layout. The queue starts out empty.
+ */
+void search_init(struct search *s, int n, enum tour_layout layout) {
+    tour_init(&s->tour, n, layout);
+    s->queue = (int *) malloc(n * sizeof(int));
+    s->queued = (char *) calloc(n, sizeof(char));
+    s->qhead = 0;
+    s->qsize = 0;
+    int k = num_neighbors > 0 ? num_neighbors : 1;
+    s->batch = (struct batch_move *) malloc(k * BATCH_PER_NEIGHBOR * sizeof(struct batch_move));
+    s->near_dist = (long long *) malloc(k * sizeof(long long));
+    s->near_next = (int *) malloc(k * sizeof(int));
+    s->near_prev = (int *) malloc(k * sizeof(int));
+}
+
+/**
+ * Deallocates the memory used by the given search state.
+ */
+void search_free(struct search *s) {
+    tour_free(&s->tour);
+    free(s->queue);
+    free(s->queued);
+    free(s->batch);
+    free(s->near_dist);
+    free(s->near_next);
+    free(s->near_prev);
+}
+
+/**
+ * Turns off the don't-look bit of the given node so it is looked at again.
+ */
+void search_wake(struct search *s, int node) {
+    if (!s->queued[node]) {
+        int n = s->tour.n;
+        int i = s->qhead + s->qsize;
+        s->queue[i >= n ? i - n : i] = node;
+        s->queued[node] = 1;
+        s->qsize++;
+    }
+}
+
+/**
+ * Turns off every don't-look bit, in path order.
+ */
+void search_wake_all(struct search *s) {
+    const int *path = tour_path(&s->tour);
+    int i;
+    for (i = 0; i < s->tour.n; i++) {
+        search_wake(s, path[i]);
+    }
+}
+
+/**
+ * Removes and returns the next node from the queue, turning its
+ * don't-look bit on. Returns -1 if every node's bit is on.
+ */
+int search_next(struct search *s) {
+    if (s->qsize == 0) {
+        return -1;
+    }
+    int node = s->queue[s->qhead];
+    s->qhead = s->qhead + 1 == s->tour.n ? 0 : s->qhead + 1;
+    s->qsize--;
+    s->queued[node] = 0;
+    return node;
+}
+
+/**
+ * Moves the segment f1..f2 (in forward order) to between x and y, where
+ * y follows x and neither is in the segment. The segment ends up as
+ * x f1..f2 y, or x f2..f1 y when reversed is set. Done as up to three
+ * 2-opt moves, so it works whichever way the tour ends up being read.
+ */
+static void move_segment(struct tour *t, int f1, int f2, int x, int y, int reversed) {
+    int p = tour_prev(t, f1), q = tour_next(t, f2);
+    tour_2opt_move(t, p, f1, x, y); // p x ... q f2..f1 y
+    tour_2opt_move(t, p, x, q, f2); // p q ... x f2..f1 y
+    if (!reversed) {
+        tour_2opt_move(t, x, f2, f1, y); // x f1..f2 y
+    }
+}
+
+/**
+ * Returns 1 if u and v are next to each other on the tour. Otherwise 0.
+ */
+static int adjacent(const struct tour *t, int u, int v) {
+    return tour_next(t, u) == v || tour_prev(t, u) == v;
+}
+
+/**
+ * Checks that every edge the given batch move breaks is still on the
+ * tour, the same way around for 2-opt. Its delta only depends on those
+ * edges, so then it's still exact, however many moves were applied since
+ * it was found.
+ */
+static int batch_valid(const struct tour *t, const struct batch_move *m) {
+    if (m->kind == BATCH_2OPT) {
+        return (tour_next(t, m->a) == m->b && tour_next(t, m->c) == m->d)
+            || (tour_prev(t, m->a) == m->b && tour_prev(t, m->c) == m->d);
+    }
+    if (m->mid != -1) {
+        if (!adjacent(t, m->f1, m->mid) || !adjacent(t, m->mid, m->f2)) {
+            return 0;
+        }
+    } else if (m->f1 != m->f2 && !adjacent(t, m->f1, m->f2)) {
+        return 0;
+    }
+    return adjacent(t, m->p, m->f1) && adjacent(t, m->f2, m->q) && adjacent(t, m->x, m->y);
+}
+
+/**
+ * Applies the given batch move, which must be valid, and wakes the nodes
+ * at the ends of the edges it changed.
+ */
+static void batch_apply(struct search *s, const struct batch_move *m) {
+    struct tour *t = &s->tour;
+    if (m->kind == BATCH_2OPT) {
+        tour_2opt_move(t, m->a, m->b, m->c, m->d);
+        search_wake(s, m->a);
+        search_wake(s, m->b);
+        search_wake(s, m->c);
+        search_wake(s, m->d);
+        return;
+    }
+    // Read the segment and the edge it goes into forward, whichever way
+    // the tour goes now
+    int f1 = m->f1, f2 = m->f2, x = m->x, y = m->y;
+    if (tour_next(t, f2) != m->q) {
+        f1 = m->f2;
+        f2 = m->f1;
+    }
+    if (tour_next(t, x) != y) {
+        x = m->y;
+        y = m->x;
+    }
+    move_segment(t, f1, f2, x, y, (x == m->x) != (m->xe == f1));
+    search_wake(s, m->p);
+    search_wake(s, m->q);
+    search_wake(s, m->f1);
+    search_wake(s, m->f2);
+    search_wake(s, m->x);
+    search_wake(s, m->y);
+}
+
+/**
+ * Applies the count batch moves found, best first. A move whose edges
+ * were broken by one applied before it is skipped, so the moves applied
+ * never overlap.
+ * @return The total change in length
+ */
+static long long batch_take(struct search *s, int count) {
+    struct batch_move *moves = s->batch;
+    int i, j;
+    // Insertion sort by delta. Only improving moves are kept, and there
+    // are seldom many of them.
+    for (i = 1; i < count; i++) {
+        struct batch_move m = moves[i];
+        for (j = i; j > 0 && moves[j - 1].delta > m.delta; j--) {
+            moves[j] = moves[j - 1];
+        }
+        moves[j] = m;
+    }
+    long long total = 0;
+    for (i = 0; i < count; i++) {
+        if (batch_valid(&s->tour, &moves[i])) {
+            batch_apply(s, &moves[i]);
+            total += moves[i].delta;
+        }
+    }
+    return total;
+}
+
+// One copy of the move types for every kind of distance matrix
+#define KIND full_u16
+#include "moves_kind.h"
+#undef KIND
+#define KIND full_u32
+#include "moves_kind.h"
+#undef KIND
+#define KIND full_float
+#include "moves_kind.h"
+#undef KIND
+#define KIND packed_u16
+#include "moves_kind.h"
+#undef KIND
+#define KIND packed_u32
+#include "moves_kind.h"
+#undef KIND
+#define KIND packed_float
+#include "moves_kind.h"
+#undef KIND
+#define KIND trunc
+#include "moves_kind.h"
+#undef KIND
+#define KIND euc_2d
+#include "moves_kind.h"
+#undef KIND
+#define KIND ceil_2d
+#include "moves_kind.h"
+#undef KIND
+#define KIND att
+#include "moves_kind.h"
+#undef KIND
+#define KIND geo
+#include "moves_kind.h"
+#undef KIND
+#define KIND man_2d
+#include "moves_kind.h"
+#undef KIND
+
+#define SWAP_IMPROVE(name, body) swap_improve_##name,
+#define TWO_OPT_IMPROVE(name, body) two_opt_improve_##name,
+#define OR_OPT_IMPROVE(name, body) or_opt_improve_##name,
+#define BATCH_IMPROVE(name, body) batch_improve_##name,
+#define SWAP_DELTA(name, body) swap_delta_##name,
+const struct move_type move_types[] = {
+    {"swap", {DIST_KINDS(SWAP_IMPROVE)}},
+    {"2opt", {DIST_KINDS(TWO_OPT_IMPROVE)}},
+    {"oropt", {DIST_KINDS(OR_OPT_IMPROVE)}},
+    {"batch", {DIST_KINDS(BATCH_IMPROVE)}},
+};
+const int num_move_types = sizeof(move_types) / sizeof(move_types[0]);
+long long (*const swap_deltas[NUM_DIST_KINDS])(const struct tour *t, int a, int b) = {
+    DIST_KINDS(SWAP_DELTA)
+};
+#undef SWAP_IMPROVE
+#undef TWO_OPT_IMPROVE
+#undef OR_OPT_IMPROVE
+#undef BATCH_IMPROVE
+#undef SWAP_DELTA
@@ -0,0 +1,71 @@
+/*
+ * Move engine for the hill climber. Each move type looks for an improving
+ * change to the path around one node, using the candidate neighbor lists,
+ * and applies the first one it finds.
+ *
+ * Nodes have a "don't-look bit": once no move improves the path around a
+ * node it is skipped until a move changes one of the edges next to it.
+ * The nodes whose bit is off are kept in a queue.
+ */
+#ifndef MOVES_H
+#define MOVES_H
+
+#include "dist.h"
+#include "tour.h"
+#include "rng.h"
+
+enum batch_kind { BATCH_2OPT, BATCH_OROPT };
+
+// A move found by the batch move type, kept until the best ones are applied
+struct batch_move {
+    long long delta; // change in length, negative
+    enum batch_kind kind;
+    // BATCH_2OPT: edges (a,b) and (c,d) become (a,c) and (b,d)
+    // BATCH_OROPT: the segment f1..f2 (mid is the node between them, if
+    // any) is taken out from between p and q and put between x and y,
+    // with xe next to x
+    int a, b, c, d;
+    int p, f1, mid, f2, q, x, y, xe;
+};
+
+// The local state of one searching thread
+struct search {
+    struct tour tour;
+    long long len; // current length of the tour
+    int *queue; // circular queue of nodes whose don't-look bit is off
+    char *queued; // queued[node] := 1 if node is in the queue
+    int qhead; // index of the next node in the queue
+    int qsize; // number of nodes in the queue
+    struct rng rng; // this thread's random number generator
+    // Scratch space for the batch move type: the moves found around a node,
+    // and the distance, next and previous node of each candidate neighbor
+    struct batch_move *batch;
+    long long *near_dist;
+    int *near_next, *near_prev;
+};
+
+struct move_type {
+    const char *name;
+    /*
+     * Looks for an improving move around the given node and applies it.
+     * Returns the change in length (negative) or 0 if nothing was found.
+     * improve[kind] only works on a thread_dists of that kind, see
+     * dist_kind_of.
+     */
+    long long (*improve[NUM_DIST_KINDS])(struct search *s, int node);
+};
+
+extern const struct move_type move_types[];
+extern const int num_move_types;
+// swap_deltas[kind](t, a, b) := how much longer t gets if nodes a and b
+// switch places, for a thread_dists of that kind. Negative is better.
+extern long long (*const swap_deltas[NUM_DIST_KINDS])(const struct tour *t, int a, int b);
+const struct move_type *find_move_type(const char *name);
+
+void search_init(struct search *s, int n, enum tour_layout layout);
+void search_free(struct search *s);
+void search_wake(struct search *s, int node);
+void search_wake_all(struct search *s);
+int search_next(struct search *s);
+
+#endif
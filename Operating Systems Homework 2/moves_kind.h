@@ -0,0 +1,291 @@
+/*
+ * The move types for one kind of distance matrix. moves.c includes this
+ * once for every kind in DIST_KINDS (see dist.h), with KIND set to the
+ * kind's name, so that every distance looked up in here is a direct call
+ * to dist_get_<KIND> with no branching on the layout, width or metric.
+ * The functions are named <function>_<KIND>.
+ *
+ * No include guard on purpose.
+ */
+#define KIND_NAME2(f, kind) f##_##kind
+#define KIND_NAME1(f, kind) KIND_NAME2(f, kind)
+#define KIND_NAME(f) KIND_NAME1(f, KIND)
+#define D(a, b) KIND_NAME(dist_get)(m, a, b)
+
+/**
+ * Returns how much longer the tour gets if nodes a and b switch places,
+ * without changing the tour. Only the (at most four) edges touching a and
+ * b change.
+ */
+static long long KIND_NAME(swap_delta)(const struct tour *t, int a, int b) {
+    const struct dist_matrix *m = thread_dists;
+    int pa = tour_prev(t, a), na = tour_next(t, a);
+    int pb = tour_prev(t, b), nb = tour_next(t, b);
+    if (na == b && nb == a) {
+        return 0; // only two nodes
+    }
+    if (na == b) {
+        // pa a b nb -> pa b a nb
+        return D(pa, b) + D(a, nb) - D(pa, a) - D(b, nb);
+    }
+    if (nb == a) {
+        // pb b a na -> pb a b na
+        return D(pb, a) + D(b, na) - D(pb, b) - D(a, na);
+    }
+    return D(pa, b) + D(b, na) + D(pb, a) + D(a, nb)
+        - D(pa, a) - D(a, na) - D(pb, b) - D(b, nb);
+}
+
+/**
+ * Swap move: tries to make one of node's candidate neighbors the next node
+ * on the path by switching it with the node currently there.
+ */
+static long long KIND_NAME(swap_improve)(struct search *s, int node) {
+    const struct dist_matrix *m = thread_dists;
+    struct tour *t = &s->tour;
+    int succ = tour_next(t, node);
+    long long d_succ = D(node, succ);
+    int *list = &neighbors[node * num_neighbors];
+    int k;
+    for (k = 0; k < num_neighbors; k++) {
+        int c = list[k];
+        if (D(node, c) >= d_succ) {
+            break; // the rest of the list is even farther away
+        }
+        long long delta = KIND_NAME(swap_delta)(t, succ, c);
+        if (delta < 0) {
+            search_wake(s, tour_prev(t, c));
+            search_wake(s, tour_next(t, c));
+            search_wake(s, tour_next(t, succ));
+            tour_swap(t, succ, c);
+            search_wake(s, node);
+            search_wake(s, succ);
+            search_wake(s, c);
+            return delta;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 2-opt move: replaces two edges of the path with two new ones, one of them
+ * connecting node to a candidate neighbor, by reversing the part in between.
+ */
+static long long KIND_NAME(two_opt_improve)(struct search *s, int node) {
+    const struct dist_matrix *m = thread_dists;
+    struct tour *t = &s->tour;
+    int *list = &neighbors[node * num_neighbors];
+    int dir, k;
+    for (dir = 0; dir < 2; dir++) {
+        // Look at the edge after node first, then the edge before it
+        int a = dir == 0 ? tour_next(t, node) : tour_prev(t, node);
+        long long d_a = D(node, a);
+        for (k = 0; k < num_neighbors; k++) {
+            int c = list[k];
+            long long d_c = D(node, c);
+            if (d_c >= d_a) {
+                break; // can't gain anything from the rest of the list
+            }
+            int b = dir == 0 ? tour_next(t, c) : tour_prev(t, c);
+            if (c == a || b == node) {
+                continue;
+            }
+            long long delta = d_c + D(a, b) - d_a - D(c, b);
+            if (delta < 0) {
+                // (node,a),(c,b) -> (node,c),(a,b)
+                tour_2opt_move(t, node, a, c, b);
+                search_wake(s, node);
+                search_wake(s, a);
+                search_wake(s, c);
+                search_wake(s, b);
+                return delta;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Or-opt move: takes a segment of up to MAX_SEGMENT nodes starting at node
+ * (going either way) out of the path and puts it back, possibly reversed,
+ * so that node ends up next to one of its candidate neighbors.
+ */
+static long long KIND_NAME(or_opt_improve)(struct search *s, int node) {
+    const struct dist_matrix *m = thread_dists;
+    struct tour *t = &s->tour;
+    int *list = &neighbors[node * num_neighbors];
+    int dir, len, k, side;
+    for (dir = 0; dir < 2; dir++) {
+        int f1 = node, f2 = node; // the segment is f1..f2 in forward order
+        for (len = 1; len <= MAX_SEGMENT && len + 3 <= t->n; len++) {
+            if (len > 1) {
+                if (dir == 0) {
+                    f2 = tour_next(t, f2);
+                } else {
+                    f1 = tour_prev(t, f1);
+                }
+            } else if (dir == 1) {
+                continue; // a single node was already tried
+            }
+            int p = tour_prev(t, f1), q = tour_next(t, f2);
+            // How much shorter the path gets by taking the segment out
+            long long gain = D(p, f1) + D(f2, q) - D(p, q);
+            int other = node == f1 ? f2 : f1; // the other end of the segment
+            for (k = 0; k < num_neighbors; k++) {
+                int c = list[k];
+                long long d_c = D(node, c);
+                if (d_c >= gain) {
+                    break; // putting it back costs more than was gained
+                }
+                if (tour_between(t, f1, c, f2)) {
+                    continue;
+                }
+                // Put the segment either after c or before c
+                for (side = 0; side < 2; side++) {
+                    int x = side == 0 ? c : tour_prev(t, c);
+                    int y = side == 0 ? tour_next(t, c) : c;
+                    int end = side == 0 ? y : x; // what 'other' gets joined to
+                    if (tour_between(t, f1, end, f2)) {
+                        continue;
+                    }
+                    long long delta = d_c + D(other, end) - D(x, y) - gain;
+                    if (delta < 0) {
+                        // node has to end up on c's side of the segment
+                        int reversed = (side == 0) != (node == f1);
+                        move_segment(t, f1, f2, x, y, reversed);
+                        search_wake(s, p);
+                        search_wake(s, q);
+                        search_wake(s, f1);
+                        search_wake(s, f2);
+                        search_wake(s, x);
+                        search_wake(s, y);
+                        return delta;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Batch move: finds every improving 2-opt and Or-opt move around node at
+ * once, then applies the best of them that don't overlap (see batch_take).
+ * The tour lookups for all the candidate neighbors are done in one pass
+ * before any distance is compared, so they don't wait on each other, and
+ * the distances for all the moves are looked up in tight loops after.
+ */
+static long long KIND_NAME(batch_improve)(struct search *s, int node) {
+    const struct dist_matrix *m = thread_dists;
+    struct tour *t = &s->tour;
+    int *list = &neighbors[node * num_neighbors];
+    long long *dc = s->near_dist;
+    int *cn = s->near_next, *cp = s->near_prev;
+    int succ = tour_next(t, node), pred = tour_prev(t, node);
+    long long d_succ = D(node, succ), d_pred = D(node, pred);
+    long long limit = d_succ > d_pred ? d_succ : d_pred;
+
+    // The segments Or-opt can move: up to MAX_SEGMENT nodes starting at
+    // node going forward, then going back
+    int seg_f1[2 * MAX_SEGMENT], seg_mid[2 * MAX_SEGMENT], seg_f2[2 * MAX_SEGMENT];
+    int seg_p[2 * MAX_SEGMENT], seg_q[2 * MAX_SEGMENT];
+    long long seg_gain[2 * MAX_SEGMENT];
+    int segs = 0, dir, len, k, i, side;
+    for (dir = 0; dir < 2; dir++) {
+        int f1 = node, f2 = node;
+        for (len = 1; len <= MAX_SEGMENT && len + 3 <= t->n; len++) {
+            if (len > 1) {
+                if (dir == 0) {
+                    f2 = tour_next(t, f2);
+                } else {
+                    f1 = tour_prev(t, f1);
+                }
+            } else if (dir == 1) {
+                continue; // a single node was already tried
+            }
+            int p = tour_prev(t, f1), q = tour_next(t, f2);
+            seg_f1[segs] = f1;
+            seg_f2[segs] = f2;
+            seg_mid[segs] = len == 3 ? tour_next(t, f1) : -1;
+            seg_p[segs] = p;
+            seg_q[segs] = q;
+            // How much shorter the path gets by taking the segment out
+            seg_gain[segs] = D(p, f1) + D(f2, q) - D(p, q);
+            limit = seg_gain[segs] > limit ? seg_gain[segs] : limit;
+            segs++;
+        }
+    }
+
+    // Only neighbors closer than limit can be part of an improving move
+    int near;
+    for (near = 0; near < num_neighbors; near++) {
+        dc[near] = D(node, list[near]);
+        if (dc[near] >= limit) {
+            break;
+        }
+    }
+    for (k = 0; k < near; k++) {
+        cn[k] = tour_next(t, list[k]);
+        cp[k] = tour_prev(t, list[k]);
+    }
+
+    struct batch_move *found = s->batch;
+    int count = 0;
+    for (k = 0; k < near; k++) {
+        int c = list[k];
+        // 2-opt on the edge after node: (node,succ),(c,cn) -> (node,c),(succ,cn)
+        if (dc[k] < d_succ && c != succ && cn[k] != node) {
+            long long delta = dc[k] + D(succ, cn[k]) - d_succ - D(c, cn[k]);
+            if (delta < 0) {
+                struct batch_move *mv = &found[count++];
+                mv->delta = delta;
+                mv->kind = BATCH_2OPT;
+                mv->a = node, mv->b = succ, mv->c = c, mv->d = cn[k];
+            }
+        }
+        // and on the edge before it
+        if (dc[k] < d_pred && c != pred && cp[k] != node) {
+            long long delta = dc[k] + D(pred, cp[k]) - d_pred - D(c, cp[k]);
+            if (delta < 0) {
+                struct batch_move *mv = &found[count++];
+                mv->delta = delta;
+                mv->kind = BATCH_2OPT;
+                mv->a = node, mv->b = pred, mv->c = c, mv->d = cp[k];
+            }
+        }
+    }
+    for (i = 0; i < segs; i++) {
+        int f1 = seg_f1[i], f2 = seg_f2[i], mid = seg_mid[i];
+        int other = node == f1 ? f2 : f1; // the other end of the segment
+        for (k = 0; k < near && dc[k] < seg_gain[i]; k++) {
+            int c = list[k];
+            if (c == f1 || c == f2 || c == mid) {
+                continue;
+            }
+            // Put the segment either after c or before c
+            for (side = 0; side < 2; side++) {
+                int x = side == 0 ? c : cp[k];
+                int y = side == 0 ? cn[k] : c;
+                int end = side == 0 ? y : x; // what 'other' gets joined to
+                if (end == f1 || end == f2 || end == mid) {
+                    continue;
+                }
+                long long delta = dc[k] + D(other, end) - D(x, y) - seg_gain[i];
+                if (delta < 0) {
+                    struct batch_move *mv = &found[count++];
+                    mv->delta = delta;
+                    mv->kind = BATCH_OROPT;
+                    mv->p = seg_p[i], mv->f1 = f1, mv->mid = mid, mv->f2 = f2, mv->q = seg_q[i];
+                    mv->x = x, mv->y = y;
+                    mv->xe = side == 0 ? node : other;
+                }
+            }
+        }
+    }
+    return batch_take(s, count);
+}
+
+#undef D
+#undef KIND_NAME
+#undef KIND_NAME1
+#undef KIND_NAME2
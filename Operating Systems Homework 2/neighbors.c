@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include "tsp.h"
+#include "grid.h"
+#include "neighbors.h"
+
+#define NODES_PER_CELL 2
+
+int num_neighbors;
+int *neighbors;
+
+/**
+ * Returns the squared distance between nodes a and b. Used for ordering
+ * only, so there's no need for the sqrt.
+ */
+static double square_dist(int a, int b) {
+    double dx = coords[2*a] - coords[2*b];
+    double dy = coords[2*a+1] - coords[2*b+1];
+    return dx*dx + dy*dy;
+}
+
+/**
+ * Offers node j to the sorted list of the count closest nodes found so far,
+ * dropping the farthest if the list is full. Ties go to the lower index.
+ * @return The new count
+ */
+static int offer(int list[], double best[], int count, int k, int j, double d) {
+    if (count == k && (d > best[k - 1] || (d == best[k - 1] && j > list[k - 1]))) {
+        return count;
+    }
+    int m = count < k ? count++ : k - 1;
+    for (; m > 0 && (best[m - 1] > d || (best[m - 1] == d && list[m - 1] > j)); m--) {
+        best[m] = best[m - 1];
+        list[m] = list[m - 1];
+    }
+    best[m] = d;
+    list[m] = j;
+    return count;
+}
+
+/**
+ * Looks through the cells in rings around node i's cell, closest ring
+ * first, until nothing in the next ring can be closer than the k'th
+ * closest node found.
+ */
+static void find_neighbors(const struct grid *g, int i, int k, int list[], double best[]) {
+    int col = grid_col(g, coords[2*i]), row = grid_row(g, coords[2*i+1]);
+    int max_ring = g->nx > g->ny ? g->nx : g->ny;
+    int count = 0, r, x, y, c;
+    for (r = 0; r <= max_ring; r++) {
+        for (y = row - r; y <= row + r; y++) {
+            if (y < 0 || y >= g->ny) {
+                continue;
+            }
+            // Only the edge of the square on the top and bottom rows
+            int step = (y == row - r || y == row + r) ? 1 : 2 * r;
+            for (x = col - r; x <= col + r; x += step > 0 ? step : 1) {
+                if (x < 0 || x >= g->nx) {
+                    continue;
+                }
+                int cell = y * g->nx + x;
+                for (c = g->start[cell]; c < g->start[cell + 1]; c++) {
+                    int j = g->nodes[c];
+                    if (j != i) {
+                        count = offer(list, best, count, k, j, square_dist(i, j));
+                    }
+                }
+            }
+        }
+        // Anything in the next ring is at least r cells away
+        double reach = r * g->size;
+        if (count == k && best[k - 1] < reach * reach) {
+            break;
+        }
+    }
+}
+
+/**
+ * Fills list with the k closest nodes to node i by looking at every node,
+ * for EXPLICIT distances where there are no coordinates to go by.
+ */
+static void find_neighbors_explicit(int i, int k, int list[], double best[]) {
+    int count = 0, j;
+    for (j = 0; j < num_nodes; j++) {
+        if (j != i) {
+            count = offer(list, best, count, k, j, (double) dist(i, j));
+        }
+    }
+}
+
+/**
+ * Fills 'neighbors' with the k closest nodes of every node, closest first.
+ * k is clamped to num_nodes-1. Must be called after the nodes are loaded.
+ * The nodes are bucketed into a grid first, so this takes about O(n k)
+ * time for evenly spread nodes instead of O(n^2). EXPLICIT distances
+ * have no coordinates, so every pair is looked at instead.
+ */
+void init_neighbors(int k) {
+    if (k > num_nodes - 1) {
+        k = num_nodes - 1;
+    }
+    if (k < 1) {
+        k = 0;
+    }
+    num_neighbors = k;
+    neighbors = (int *) malloc(((size_t)num_nodes * k + 1) * sizeof(int));
+    double best[k > 0 ? k : 1]; // squared distances of the list so far
+
+    int i;
+    if (dists.metric == METRIC_EXPLICIT) {
+        for (i = 0; i < num_nodes && k > 0; i++) {
+            find_neighbors_explicit(i, k, &neighbors[(size_t)i * k], best);
+        }
+        return;
+    }
+    struct grid g;
+    grid_build(&g, num_nodes, coords, NODES_PER_CELL);
+    for (i = 0; i < num_nodes && k > 0; i++) {
+        find_neighbors(&g, i, k, &neighbors[(size_t)i * k], best);
+    }
+    grid_free(&g);
+}
+
+/**
+ * Deallocates the neighbor lists.
+ */
+void free_neighbors() {
+    free(neighbors);
+    neighbors = NULL;
+}
@@ -0,0 +1,16 @@
+/*
+ * Candidate neighbor lists. For every node, the closest few other nodes
+ * (by coordinates) are precomputed so that moves only need to look at
+ * nodes that are likely to be next to each other in a good path.
+ */
+#ifndef NEIGHBORS_H
+#define NEIGHBORS_H
+
+extern int num_neighbors; // length of each node's list
+// neighbors[node*num_neighbors + i] := the i'th closest node to node
+extern int *neighbors;
+
+void init_neighbors(int k);
+void free_neighbors();
+
+#endif
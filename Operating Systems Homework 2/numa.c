@@ -0,0 +1,200 @@
+#define _GNU_SOURCE // for sched_setaffinity, sched_getcpu and the CPU_ macros
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numa.h"
+
+#define NODE_PATH "/sys/devices/system/node/node%d/cpulist"
+#define MAX_LIST 8192 // longest cpulist read from sysfs
+
+/**
+ * Returns the number of NUMA nodes, at least 1. Nodes are assumed to be
+ * numbered from 0 without gaps.
+ */
+int numa_node_count() {
+    char path[64];
+    int count = 0;
+    while (1) {
+        snprintf(path, sizeof(path), NODE_PATH, count);
+        FILE *f = fopen(path, "r");
+        if (f == NULL) {
+            break;
+        }
+        fclose(f);
+        count++;
+    }
+    return count > 0 ? count : 1;
+}
+
+/**
+ * Reads a CPU list like "0-7,16-23" into cpus, in order.
+ * @return The number of CPUs read, or -1 if the list isn't valid
+ */
+static int parse_cpulist(const char *text, int cpus[], int max) {
+    int count = 0;
+    const char *p = text;
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10), last;
+        if (end == p || first < 0) {
+            return -1;
+        }
+        last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) {
+                return -1;
+            }
+            p = end;
+        }
+        for (; first <= last; first++) {
+            if (count < max) {
+                cpus[count] = (int) first;
+            }
+            count++;
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0' && *p != '\n') {
+            return -1;
+        }
+    }
+    return count < max ? count : max;
+}
+
+/**
+ * Reads the CPUs of the given node that this process may run on into cpus.
+ * @return The number of CPUs, 0 if the node isn't known
+ */
+static int node_cpus(int node, int cpus[], int max) {
+    char path[64], text[MAX_LIST];
+    snprintf(path, sizeof(path), NODE_PATH, node);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    int count = fgets(text, sizeof(text), f) != NULL ? parse_cpulist(text, cpus, max) : 0;
+    fclose(f);
+
+    cpu_set_t allowed;
+    if (count <= 0 || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return count > 0 ? count : 0;
+    }
+    int i, kept = 0;
+    for (i = 0; i < count; i++) {
+        if (cpus[i] < CPU_SETSIZE && CPU_ISSET(cpus[i], &allowed)) {
+            cpus[kept++] = cpus[i];
+        }
+    }
+    return kept;
+}
+
+/**
+ * Returns the node the given CPU belongs to, 0 if it isn't known.
+ */
+int numa_cpu_node(int cpu) {
+    int nodes = numa_node_count(), node, i;
+    int *cpus = (int *) malloc(CPU_SETSIZE * sizeof(int));
+    for (node = 0; node < nodes; node++) {
+        int count = node_cpus(node, cpus, CPU_SETSIZE);
+        for (i = 0; i < count && cpus[i] != cpu; i++);
+        if (i < count) {
+            break;
+        }
+    }
+    free(cpus);
+    return node < nodes ? node : 0;
+}
+
+/**
+ * Returns the CPU the calling thread is running on right now, or -1.
+ */
+int numa_current_cpu() {
+    return sched_getcpu();
+}
+
+/**
+ * Fills cpus with the CPUs threads 0, 1, 2, ... should run on under the
+ * given policy (see numa.h). Thread t gets cpus[t % count].
+ * @return The number of CPUs, or -1 if the policy isn't valid
+ */
+int numa_placement(const char *policy, int cpus[], int max) {
+    if (strcmp(policy, "compact") != 0 && strcmp(policy, "scatter") != 0) {
+        return parse_cpulist(policy, cpus, max);
+    }
+    int nodes = numa_node_count(), node, count = 0, i;
+    int **lists = (int **) malloc(nodes * sizeof(int *));
+    int *sizes = (int *) calloc(nodes, sizeof(int));
+    int total = 0;
+    for (node = 0; node < nodes; node++) {
+        lists[node] = (int *) malloc(CPU_SETSIZE * sizeof(int));
+        sizes[node] = node_cpus(node, lists[node], CPU_SETSIZE);
+        total += sizes[node];
+    }
+    if (total == 0) {
+        // No sysfs: every CPU the process may use, as one node
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (i = 0; i < CPU_SETSIZE && sizes[0] < CPU_SETSIZE; i++) {
+                if (CPU_ISSET(i, &allowed)) {
+                    lists[0][sizes[0]++] = i;
+                }
+            }
+        }
+        total = sizes[0];
+    }
+    if (strcmp(policy, "compact") == 0) {
+        for (node = 0; node < nodes; node++) {
+            for (i = 0; i < sizes[node] && count < max; i++) {
+                cpus[count++] = lists[node][i];
+            }
+        }
+    } else {
+        for (i = 0; count < total && count < max; i++) {
+            for (node = 0; node < nodes && count < max; node++) {
+                if (i < sizes[node]) {
+                    cpus[count++] = lists[node][i];
+                }
+            }
+        }
+    }
+    for (node = 0; node < nodes; node++) {
+        free(lists[node]);
+    }
+    free(lists);
+    free(sizes);
+    return count;
+}
+
+/**
+ * Restricts the calling thread, and threads it creates afterwards, to the
+ * CPUs of the given node.
+ * @return 1 if it worked. Otherwise 0.
+ */
+int numa_bind_node(int node) {
+    int *cpus = (int *) malloc(CPU_SETSIZE * sizeof(int));
+    int count = node_cpus(node, cpus, CPU_SETSIZE), i;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (i = 0; i < count; i++) {
+        CPU_SET(cpus[i], &set);
+    }
+    free(cpus);
+    return count > 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+/**
+ * Restricts the calling thread to the given CPU.
+ * @return 1 if it worked. Otherwise 0.
+ */
+int numa_bind_cpu(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return 0;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * NUMA nodes and CPU placement on Linux, read from sysfs so no library is
+ * needed. On a machine without NUMA (or without sysfs) everything is one
+ * node holding every CPU.
+ *
+ * Threads can be placed with a policy:
+ *    compact: fill the CPUs of node 0 first, then node 1, ...
+ *    scatter: one CPU from each node in turn
+ *    a CPU list like "0-3,8,10-11": exactly those CPUs, in that order
+ * Only the CPUs the process is allowed to run on are used by compact and
+ * scatter.
+ */
+#ifndef NUMA_H
+#define NUMA_H
+
+int numa_node_count();
+int numa_cpu_node(int cpu);
+int numa_current_cpu();
+int numa_placement(const char *policy, int cpus[], int max);
+int numa_bind_node(int node);
+int numa_bind_cpu(int cpu);
+
+#endif
@@ -0,0 +1,53 @@
+#include "rng.h"
+
+/**
+ * splitmix64, used to spread the bits of the seed over the whole state.
+ */
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Advances the generator by 2^128 draws.
+ */
+static void rng_jump(struct rng *r) {
+    static const uint64_t jump[] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i, b;
+    for (i = 0; i < 4; i++) {
+        for (b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b)) {
+                s0 ^= r->s[0];
+                s1 ^= r->s[1];
+                s2 ^= r->s[2];
+                s3 ^= r->s[3];
+            }
+            rng_next(r);
+        }
+    }
+    r->s[0] = s0;
+    r->s[1] = s1;
+    r->s[2] = s2;
+    r->s[3] = s3;
+}
+
+/**
+ * Seeds the generator with the given master seed. Each stream number gets
+ * its own non-overlapping sequence of 2^128 draws, so give every thread a
+ * different stream.
+ */
+void rng_seed(struct rng *r, uint64_t seed, int stream) {
+    int i;
+    for (i = 0; i < 4; i++) {
+        r->s[i] = splitmix64(&seed);
+    }
+    for (i = 0; i < stream; i++) {
+        rng_jump(r);
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * Small, fast pseudo random number generator (xoshiro256**).
+ * Every thread owns its own generator, so there is no shared state to
+ * fight over, and all of them are derived from one master seed so a run
+ * can be repeated.
+ */
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+struct rng {
+    uint64_t s[4];
+};
+
+void rng_seed(struct rng *r, uint64_t seed, int stream);
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * Returns the next 64 random bits.
+ */
+static inline uint64_t rng_next(struct rng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return result;
+}
+
+/**
+ * Will generate and return a random integer in the range [0, n), n > 0.
+ * Unlike rand() % n every value is equally likely: a 32 bit draw is scaled
+ * up by n and the few draws that would favor some values are thrown away.
+ */
+static inline int rng_int(struct rng *r, int n) {
+    uint32_t bound = (uint32_t) n;
+    uint64_t m = (rng_next(r) >> 32) * bound;
+    if ((uint32_t) m < bound) {
+        uint32_t threshold = -bound % bound;
+        while ((uint32_t) m < threshold) {
+            m = (rng_next(r) >> 32) * bound;
+        }
+    }
+    return (int) (m >> 32);
+}
+
+/**
+ * Returns a random double in the range [0, 1), from the top 53 bits.
+ */
+static inline double rng_double(struct rng *r) {
+    return (rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#define _POSIX_C_SOURCE 200809L // for shm_open, ftruncate and getpid
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "shared.h"
+
+/**
+ * Allocates a zeroed block of the given size that stays shared with
+ * processes forked afterwards.
+ * @return The block, or NULL if it couldn't be allocated
+ */
+void *shared_alloc(size_t bytes) {
+    static int count = 0;
+    char name[64];
+    snprintf(name, sizeof(name), "/tsp-%ld-%d", (long) getpid(), count++);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    shm_unlink(name); // the mapping keeps it alive
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    if (ftruncate(fd, (off_t) bytes) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/**
+ * Unmaps a block from shared_alloc in the calling process.
+ */
+void shared_free(void *p, size_t bytes) {
+    if (p != NULL) {
+        munmap(p, bytes > 0 ? bytes : 1);
+    }
+}
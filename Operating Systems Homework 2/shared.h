@@ -0,0 +1,14 @@
+/*
+ * Memory shared between processes. A block is created with shm_open and
+ * mapped, then its name is removed right away, so it can't be left behind
+ * if the program dies. Processes forked after that share the block.
+ */
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stddef.h>
+
+void *shared_alloc(size_t bytes);
+void shared_free(void *p, size_t bytes);
+
+#endif
@@ -0,0 +1,272 @@
+#include "simd.h"
+
+#if !defined(NO_SIMD) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * Returns the widest vector instructions this CPU supports.
+ */
+enum simd_level simd_level() {
+#ifdef HAVE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SIMD_SSE41;
+    }
+#endif
+    return SIMD_SCALAR;
+}
+
+/**
+ * Returns a printable name for the given level.
+ */
+const char *simd_level_name(enum simd_level level) {
+    switch (level) {
+        case SIMD_AVX2:
+            return "AVX2";
+        case SIMD_SSE41:
+            return "SSE4.1";
+        default:
+            return "scalar";
+    }
+}
+
+/**
+ * Plain C version of simd_dist_row. There's a loop for every metric, so
+ * the metric is picked once instead of for every distance.
+ */
+static void row_scalar(enum dist_metric metric, const double coords[], int i, int j0, int j1,
+        double out[]) {
+    int j;
+#define ROW_SCALAR(metric) \
+    for (j = j0; j < j1; j++) { \
+        out[j - j0] = dist_metric(metric, coords, i, j); \
+    } \
+    break;
+    switch (metric) {
+        case METRIC_EUC_2D:
+            ROW_SCALAR(METRIC_EUC_2D)
+        case METRIC_CEIL_2D:
+            ROW_SCALAR(METRIC_CEIL_2D)
+        case METRIC_ATT:
+            ROW_SCALAR(METRIC_ATT)
+        case METRIC_GEO:
+            ROW_SCALAR(METRIC_GEO)
+        case METRIC_MAN_2D:
+            ROW_SCALAR(METRIC_MAN_2D)
+        default:
+            ROW_SCALAR(METRIC_TRUNC)
+    }
+#undef ROW_SCALAR
+}
+
+#ifdef HAVE_X86
+// Runs body over j0..j1 a vector of width nodes at a time, with dx and dy
+// set to the differences to node i and the result left in d. The rest is
+// done in plain C.
+#define ROW_LOOP(width, body) \
+    for (; j + width <= j1; j += width) { \
+        body \
+    } \
+    break;
+
+/**
+ * AVX2 version of simd_dist_row, 4 nodes at a time.
+ */
+__attribute__((target("avx2")))
+static void row_avx2(enum dist_metric metric, const double coords[], const double xs[],
+        const double ys[], int i, int j0, int j1, double out[]) {
+    const __m256d xi = _mm256_set1_pd(xs[i]), yi = _mm256_set1_pd(ys[i]);
+    const __m256d half = _mm256_set1_pd(0.5), one = _mm256_set1_pd(1.0);
+    const __m256d ten = _mm256_set1_pd(10.0), sign = _mm256_set1_pd(-0.0);
+    int j = j0;
+#define DIFFS \
+    __m256d dx = _mm256_sub_pd(xi, _mm256_loadu_pd(&xs[j])); \
+    __m256d dy = _mm256_sub_pd(yi, _mm256_loadu_pd(&ys[j]));
+#define SQUARES DIFFS \
+    __m256d s = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    switch (metric) {
+        case METRIC_EUC_2D:
+            ROW_LOOP(4, SQUARES
+                __m256d d = _mm256_floor_pd(_mm256_add_pd(_mm256_sqrt_pd(s), half));
+                _mm256_storeu_pd(&out[j - j0], d);)
+        case METRIC_CEIL_2D:
+            ROW_LOOP(4, SQUARES
+                __m256d d = _mm256_ceil_pd(_mm256_sqrt_pd(s));
+                _mm256_storeu_pd(&out[j - j0], d);)
+        case METRIC_ATT:
+            ROW_LOOP(4, SQUARES
+                __m256d r = _mm256_sqrt_pd(_mm256_div_pd(s, ten));
+                __m256d d = _mm256_floor_pd(_mm256_add_pd(r, half));
+                d = _mm256_add_pd(d, _mm256_and_pd(_mm256_cmp_pd(d, r, _CMP_LT_OQ), one));
+                _mm256_storeu_pd(&out[j - j0], d);)
+        case METRIC_MAN_2D:
+            ROW_LOOP(4, DIFFS
+                __m256d m = _mm256_add_pd(_mm256_andnot_pd(sign, dx), _mm256_andnot_pd(sign, dy));
+                __m256d d = _mm256_floor_pd(_mm256_add_pd(m, half));
+                _mm256_storeu_pd(&out[j - j0], d);)
+        case METRIC_TRUNC:
+            // The squared distance goes through a float, like in dist_metric
+            ROW_LOOP(4, SQUARES
+                s = _mm256_cvtps_pd(_mm256_cvtpd_ps(s));
+                __m256d d = _mm256_floor_pd(_mm256_sqrt_pd(s));
+                _mm256_storeu_pd(&out[j - j0], d);)
+        default:
+            break;
+    }
+#undef SQUARES
+#undef DIFFS
+    row_scalar(metric, coords, i, j, j1, &out[j - j0]);
+}
+
+/**
+ * SSE4.1 version of simd_dist_row, 2 nodes at a time.
+ */
+__attribute__((target("sse4.1")))
+static void row_sse41(enum dist_metric metric, const double coords[], const double xs[],
+        const double ys[], int i, int j0, int j1, double out[]) {
+    const __m128d xi = _mm_set1_pd(xs[i]), yi = _mm_set1_pd(ys[i]);
+    const __m128d half = _mm_set1_pd(0.5), one = _mm_set1_pd(1.0);
+    const __m128d ten = _mm_set1_pd(10.0), sign = _mm_set1_pd(-0.0);
+    int j = j0;
+#define DIFFS \
+    __m128d dx = _mm_sub_pd(xi, _mm_loadu_pd(&xs[j])); \
+    __m128d dy = _mm_sub_pd(yi, _mm_loadu_pd(&ys[j]));
+#define SQUARES DIFFS \
+    __m128d s = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+    switch (metric) {
+        case METRIC_EUC_2D:
+            ROW_LOOP(2, SQUARES
+                __m128d d = _mm_floor_pd(_mm_add_pd(_mm_sqrt_pd(s), half));
+                _mm_storeu_pd(&out[j - j0], d);)
+        case METRIC_CEIL_2D:
+            ROW_LOOP(2, SQUARES
+                __m128d d = _mm_ceil_pd(_mm_sqrt_pd(s));
+                _mm_storeu_pd(&out[j - j0], d);)
+        case METRIC_ATT:
+            ROW_LOOP(2, SQUARES
+                __m128d r = _mm_sqrt_pd(_mm_div_pd(s, ten));
+                __m128d d = _mm_floor_pd(_mm_add_pd(r, half));
+                d = _mm_add_pd(d, _mm_and_pd(_mm_cmplt_pd(d, r), one));
+                _mm_storeu_pd(&out[j - j0], d);)
+        case METRIC_MAN_2D:
+            ROW_LOOP(2, DIFFS
+                __m128d m = _mm_add_pd(_mm_andnot_pd(sign, dx), _mm_andnot_pd(sign, dy));
+                __m128d d = _mm_floor_pd(_mm_add_pd(m, half));
+                _mm_storeu_pd(&out[j - j0], d);)
+        case METRIC_TRUNC:
+            ROW_LOOP(2, SQUARES
+                s = _mm_cvtps_pd(_mm_cvtpd_ps(s));
+                __m128d d = _mm_floor_pd(_mm_sqrt_pd(s));
+                _mm_storeu_pd(&out[j - j0], d);)
+        default:
+            break;
+    }
+#undef SQUARES
+#undef DIFFS
+    row_scalar(metric, coords, i, j, j1, &out[j - j0]);
+}
+#endif
+
+/**
+ * Computes the distances from node i to nodes j0..j1-1 into out[0..j1-j0-1].
+ * coords holds the nodes as x, y pairs; xs and ys hold the same values as
+ * separate arrays so they can be loaded a vector at a time.
+ * @param level The instructions to use, at most simd_level()
+ */
+void simd_dist_row(enum simd_level level, enum dist_metric metric, const double coords[],
+        const double xs[], const double ys[], int i, int j0, int j1, double out[]) {
+#ifdef HAVE_X86
+    if (level == SIMD_AVX2) {
+        row_avx2(metric, coords, xs, ys, i, j0, j1, out);
+        return;
+    }
+    if (level == SIMD_SSE41) {
+        row_sse41(metric, coords, xs, ys, i, j0, j1, out);
+        return;
+    }
+#else
+    (void) level;
+    (void) xs;
+    (void) ys;
+#endif
+    row_scalar(metric, coords, i, j0, j1, out);
+}
+
+#ifdef HAVE_X86
+/**
+ * AVX2 version of simd_path_len for a full matrix. The entries of 8 edges
+ * are fetched at once with a gather. 16 bit entries are gathered as 32
+ * bits and masked, which is why dist_matrix_build pads the matrix.
+ * Integer entries are widened and added up in 64 bit lanes, float ones in
+ * doubles, which are exact for sums of whole numbers below 2^53.
+ * @return The length of every edge from path[0] up to path[end], and end
+ */
+__attribute__((target("avx2")))
+static long long path_avx2(const struct dist_matrix *m, const int path[], int *end) {
+    const __m256i n = _mm256_set1_epi32(m->n), low = _mm256_set1_epi32(0xFFFF);
+    __m256i sum = _mm256_setzero_si256();
+    __m256d fsum = _mm256_setzero_pd();
+    int i;
+    for (i = 0; i + 8 < m->n; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) &path[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *) &path[i + 1]);
+        __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(a, n), b);
+        __m256i d;
+        if (m->width == DIST_FLOAT) {
+            __m256 f = _mm256_i32gather_ps((const float *) m->data, index, 4);
+            // Truncated first, like dist_matrix_get does
+            f = _mm256_round_ps(f, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+            fsum = _mm256_add_pd(fsum, _mm256_cvtps_pd(_mm256_castps256_ps128(f)));
+            fsum = _mm256_add_pd(fsum, _mm256_cvtps_pd(_mm256_extractf128_ps(f, 1)));
+            continue;
+        }
+        if (m->width == DIST_U16) {
+            d = _mm256_i32gather_epi32((const int *) m->data, index, 2);
+            d = _mm256_and_si256(d, low);
+        } else {
+            d = _mm256_i32gather_epi32((const int *) m->data, index, 4);
+        }
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(d)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(d, 1)));
+    }
+    long long lanes[4];
+    double flanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, sum);
+    _mm256_storeu_pd(flanes, fsum);
+    *end = i;
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+        + (long long) (flanes[0] + flanes[1] + flanes[2] + flanes[3]);
+}
+#endif
+
+/**
+ * Returns the length of the given round trip through all m->n nodes.
+ * The vector version only works on a full matrix small enough for 32 bit
+ * indexes; anything else is added up in plain C.
+ * @param level The instructions to use, at most simd_level()
+ */
+long long simd_path_len(enum simd_level level, const struct dist_matrix *m, const int path[]) {
+    int n = m->n, i = 0;
+    long long sum = 0;
+#ifdef HAVE_X86
+    if (level == SIMD_AVX2 && m->layout == DIST_FULL && n <= 46340) {
+        sum = path_avx2(m, path, &i);
+    }
+#else
+    (void) level;
+#endif
+    // Two sums so the additions don't all wait on each other
+    long long other = 0;
+    for (; i + 2 < n; i += 2) {
+        sum += dist_matrix_get(m, path[i], path[i + 1]);
+        other += dist_matrix_get(m, path[i + 1], path[i + 2]);
+    }
+    for (; i + 1 < n; i++) {
+        sum += dist_matrix_get(m, path[i], path[i + 1]);
+    }
+    return sum + other + dist_matrix_get(m, path[n - 1], path[0]);
+}
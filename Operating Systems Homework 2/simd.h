@@ -0,0 +1,23 @@
+/*
+ * Vectorized kernels for the distance matrix build and for full path
+ * lengths. Each kernel has an AVX2 and an SSE4.1 version plus plain C,
+ * and the best one the CPU supports is picked when it's called, so the
+ * program still runs anywhere. The vector versions give exactly the same
+ * distances as dist_metric; GEO is always done in plain C.
+ *
+ * Compiling with -DNO_SIMD leaves out the vector versions.
+ */
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "dist.h"
+
+enum simd_level { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2 };
+
+enum simd_level simd_level();
+const char *simd_level_name(enum simd_level level);
+void simd_dist_row(enum simd_level level, enum dist_metric metric, const double coords[],
+        const double xs[], const double ys[], int i, int j0, int j1, double out[]);
+long long simd_path_len(enum simd_level level, const struct dist_matrix *m, const int path[]);
+
+#endif
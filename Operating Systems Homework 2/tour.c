@@ -0,0 +1,483 @@
+#include <math.h>
+#include <stdlib.h>
+#include "tour.h"
+
+#define TOUR_MAX_GROWTH 4 // the list is rebuilt once a segment grows this many times over
+
+/**
+ * Allocates a tour with room for n nodes in the given layout. The path is
+ * left unset, so fill t->path and call tour_update_pos before using it.
+ */
+void tour_init(struct tour *t, int n, enum tour_layout layout) {
+    t->n = n;
+    t->layout = layout;
+    t->path = (int *) malloc(n * sizeof(int));
+    t->pos = NULL;
+    t->nodes = NULL;
+    t->segs = NULL;
+    t->buf = NULL;
+    t->num_segs = 0;
+    if (layout == TOUR_ARRAY) {
+        t->pos = (int *) malloc(n * sizeof(int));
+        return;
+    }
+    // About sqrt(n) segments of about sqrt(n) nodes, at least two of them
+    t->num_segs = (int) sqrt((double) n);
+    if (t->num_segs < 2) {
+        t->num_segs = 2;
+    }
+    t->nodes = (struct tour_node *) malloc(n * sizeof(struct tour_node));
+    t->segs = (struct tour_seg *) malloc(t->num_segs * sizeof(struct tour_seg));
+    t->buf = (int *) malloc((n + 2 * t->num_segs) * sizeof(int));
+}
+
+/**
+ * Deallocates the memory used by the given tour.
+ */
+void tour_free(struct tour *t) {
+    free(t->path);
+    free(t->pos);
+    free(t->nodes);
+    free(t->segs);
+    free(t->buf);
+}
+
+/**
+ * Returns a printable name for the given layout.
+ */
+const char *tour_layout_name(enum tour_layout layout) {
+    return layout == TOUR_LIST ? "list" : "array";
+}
+
+/**
+ * Cuts t->path into equal segments, in order and none of them reversed.
+ */
+static void list_build(struct tour *t) {
+    int n = t->n, k = t->num_segs, s, i;
+    for (s = 0; s < k; s++) {
+        struct tour_seg *seg = &t->segs[s];
+        int start = (int) ((long long) s * n / k), end = (int) ((long long) (s + 1) * n / k);
+        seg->reversed = 0;
+        seg->first = t->path[start];
+        seg->last = t->path[end - 1];
+        seg->prev = s == 0 ? k - 1 : s - 1;
+        seg->next = s + 1 == k ? 0 : s + 1;
+        seg->rank = s;
+        seg->size = end - start;
+        for (i = start; i < end; i++) {
+            struct tour_node *v = &t->nodes[t->path[i]];
+            v->prev = i == start ? -1 : t->path[i - 1];
+            v->next = i + 1 == end ? -1 : t->path[i + 1];
+            v->seg = s;
+            v->rank = i - start;
+        }
+    }
+}
+
+/**
+ * Rebuilds the position index (or the list) after t->path was written
+ * directly.
+ */
+void tour_update_pos(struct tour *t) {
+    int i;
+    if (t->layout == TOUR_LIST) {
+        list_build(t);
+        return;
+    }
+    for (i = 0; i < t->n; i++) {
+        t->pos[t->path[i]] = i;
+    }
+}
+
+/**
+ * Returns the nodes in travel order. In the list layout they're written
+ * into t->path first, which takes O(n); in the array layout that's just
+ * t->path. Don't write into it without calling tour_update_pos after.
+ */
+int *tour_path(struct tour *t) {
+    if (t->layout == TOUR_ARRAY) {
+        return t->path;
+    }
+    // Where each segment's nodes go, starting from the segment ranked 0 so
+    // the same tour always gives the same path
+    int k = t->num_segs, *at = t->buf, *cur = &t->buf[k];
+    int s = 0, i = 0, seg, left;
+    while (t->segs[s].rank != 0) {
+        s++;
+    }
+    seg = s;
+    do {
+        at[seg] = i;
+        i += t->segs[seg].size;
+        cur[seg] = t->segs[seg].reversed ? t->segs[seg].last : t->segs[seg].first;
+        seg = t->segs[seg].next;
+    } while (seg != s);
+    // Walk all the segments a step at a time instead of one after the
+    // other. Every step is a cache miss on big tours, and this way they
+    // don't have to wait for each other.
+    do {
+        left = 0;
+        for (seg = 0; seg < k; seg++) {
+            int node = cur[seg];
+            if (node == -1) {
+                continue;
+            }
+            t->path[at[seg]++] = node;
+            cur[seg] = t->segs[seg].reversed ? t->nodes[node].prev : t->nodes[node].next;
+            left = 1;
+        }
+    } while (left);
+    return t->path;
+}
+
+/**
+ * Returns a number for where the node is in the list layout, increasing
+ * in travel order except once, where the trip passes segment rank 0.
+ */
+static long long list_key(const struct tour *t, int node) {
+    const struct tour_node *v = &t->nodes[node];
+    const struct tour_seg *s = &t->segs[v->seg];
+    return (long long) s->rank * (2 * (long long) t->n + 1) + t->n
+        + (s->reversed ? -v->rank : v->rank);
+}
+
+/**
+ * Returns 1 if b is on the way when traveling forward from a to c
+ * (a and c included). Otherwise 0.
+ */
+int tour_between(const struct tour *t, int a, int b, int c) {
+    long long pa, pb, pc;
+    if (t->layout == TOUR_ARRAY) {
+        pa = t->pos[a], pb = t->pos[b], pc = t->pos[c];
+    } else {
+        pa = list_key(t, a), pb = list_key(t, b), pc = list_key(t, c);
+    }
+    if (pa <= pc) {
+        return pa <= pb && pb <= pc;
+    }
+    return pb >= pa || pb <= pc;
+}
+
+/**
+ * Numbers the nodes of a segment 0, 1, 2, ... along next.
+ */
+static void list_renumber(struct tour *t, struct tour_seg *s) {
+    int node, rank = 0;
+    for (node = s->first; node != -1; node = t->nodes[node].next) {
+        t->nodes[node].rank = rank++;
+    }
+}
+
+/**
+ * Takes the first node in travel order out of segment s and returns it.
+ * The segment must have at least two nodes.
+ */
+static int list_pop_head(struct tour *t, struct tour_seg *s) {
+    int v;
+    if (!s->reversed) {
+        v = s->first;
+        s->first = t->nodes[v].next;
+        t->nodes[s->first].prev = -1;
+    } else {
+        v = s->last;
+        s->last = t->nodes[v].prev;
+        t->nodes[s->last].next = -1;
+    }
+    s->size--;
+    return v;
+}
+
+/**
+ * Takes the last node in travel order out of segment s and returns it.
+ * The segment must have at least two nodes.
+ */
+static int list_pop_tail(struct tour *t, struct tour_seg *s) {
+    int v;
+    if (!s->reversed) {
+        v = s->last;
+        s->last = t->nodes[v].prev;
+        t->nodes[s->last].next = -1;
+    } else {
+        v = s->first;
+        s->first = t->nodes[v].next;
+        t->nodes[s->first].prev = -1;
+    }
+    s->size--;
+    return v;
+}
+
+/**
+ * Puts node v at the end of segment s in travel order.
+ */
+static void list_push_tail(struct tour *t, int seg, int v) {
+    struct tour_seg *s = &t->segs[seg];
+    struct tour_node *node = &t->nodes[v];
+    if (!s->reversed) {
+        node->prev = s->last;
+        node->next = -1;
+        t->nodes[s->last].next = v;
+        s->last = v;
+    } else {
+        node->next = s->first;
+        node->prev = -1;
+        t->nodes[s->first].prev = v;
+        s->first = v;
+    }
+    node->seg = seg;
+    s->size++;
+}
+
+/**
+ * Puts node v at the start of segment s in travel order.
+ */
+static void list_push_head(struct tour *t, int seg, int v) {
+    struct tour_seg *s = &t->segs[seg];
+    struct tour_node *node = &t->nodes[v];
+    if (!s->reversed) {
+        node->next = s->first;
+        node->prev = -1;
+        t->nodes[s->first].prev = v;
+        s->first = v;
+    } else {
+        node->prev = s->last;
+        node->next = -1;
+        t->nodes[s->last].next = v;
+        s->last = v;
+    }
+    node->seg = seg;
+    s->size++;
+}
+
+/**
+ * Makes x the first node of a segment by moving the nodes before it in
+ * its segment to the end of the segment before, or x and the nodes after
+ * it to the start of the segment after, whichever is fewer.
+ * If keep isn't -1, it's the first node of a segment and stays that way.
+ */
+static void list_split(struct tour *t, int x, int keep) {
+    int seg = t->nodes[x].seg;
+    struct tour_seg *s = &t->segs[seg];
+    int head = s->reversed ? s->last : s->first;
+    if (head == x) {
+        return;
+    }
+    int before = abs(t->nodes[x].rank - t->nodes[head].rank);
+    int keep_seg = keep == -1 ? -1 : t->nodes[keep].seg;
+    // Moving the nodes before x would move keep if it's in this segment,
+    // and moving the rest would put them in front of keep if keep's
+    // segment is next
+    int move_before = keep_seg == seg ? 0 : s->next == keep_seg ? 1 : before <= s->size - before;
+    int other, v;
+    if (move_before) {
+        other = s->prev;
+        do {
+            v = list_pop_head(t, s);
+            list_push_tail(t, other, v);
+        } while (tour_next(t, v) != x);
+    } else {
+        other = s->next;
+        do {
+            v = list_pop_tail(t, s);
+            list_push_head(t, other, v);
+        } while (v != x);
+    }
+    list_renumber(t, s);
+    list_renumber(t, &t->segs[other]);
+}
+
+/**
+ * Reverses the nodes a..b of one segment, where a comes before b in
+ * travel order.
+ */
+static void list_reverse_within(struct tour *t, int a, int b) {
+    struct tour_seg *s = &t->segs[t->nodes[a].seg];
+    // lo..hi in next order
+    int lo = s->reversed ? b : a, hi = s->reversed ? a : b;
+    int before = t->nodes[lo].prev, after = t->nodes[hi].next;
+    int count = 0, rank = t->nodes[lo].rank, i, node;
+    for (node = lo; ; node = t->nodes[node].next) {
+        t->buf[count++] = node;
+        if (node == hi) {
+            break;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        struct tour_node *v = &t->nodes[t->buf[count - 1 - i]];
+        v->prev = i == 0 ? before : t->buf[count - i];
+        v->next = i + 1 == count ? after : t->buf[count - 2 - i];
+        v->rank = rank + i;
+    }
+    if (before == -1) {
+        s->first = hi;
+    } else {
+        t->nodes[before].next = hi;
+    }
+    if (after == -1) {
+        s->last = lo;
+    } else {
+        t->nodes[after].prev = lo;
+    }
+}
+
+/**
+ * Reverses the count whole segments starting at segment first, in travel
+ * order: flips their bits and links them in the opposite order, with the
+ * same ranks they had between them.
+ */
+static void list_reverse_segs(struct tour *t, int first, int count) {
+    int *run = t->buf, i, s = first;
+    for (i = 0; i < count; i++) {
+        run[i] = s;
+        s = t->segs[s].next;
+    }
+    int before = t->segs[run[0]].prev, after = s;
+    int *ranks = &t->buf[count];
+    for (i = 0; i < count; i++) {
+        ranks[i] = t->segs[run[i]].rank;
+    }
+    // before, run[count-1], ..., run[0], after
+    for (i = 0; i < count; i++) {
+        struct tour_seg *seg = &t->segs[run[count - 1 - i]];
+        seg->reversed = !seg->reversed;
+        seg->rank = ranks[i];
+        seg->prev = i == 0 ? before : run[count - i];
+        seg->next = i + 1 == count ? after : run[count - 2 - i];
+    }
+    t->segs[before].next = run[count - 1];
+    t->segs[after].prev = run[0];
+}
+
+/**
+ * tour_flip for the list layout.
+ */
+static void list_flip(struct tour *t, int a, int b) {
+    if (a == b || tour_next(t, b) == a) {
+        return; // one node, or the whole trip, which is the same trip
+    }
+    int sa = t->nodes[a].seg, sb = t->nodes[b].seg;
+    if (sa == sb) {
+        long long ka = list_key(t, a), kb = list_key(t, b);
+        // Either a..b or the rest of the trip is inside the segment
+        if (ka <= kb) {
+            list_reverse_within(t, a, b);
+        } else {
+            list_reverse_within(t, tour_next(t, b), tour_prev(t, a));
+        }
+        return;
+    }
+    // Make a..b whole segments, then reverse those or the rest, whichever
+    // are fewer
+    list_split(t, a, -1);
+    list_split(t, tour_next(t, b), a);
+    int k = t->num_segs;
+    sa = t->nodes[a].seg;
+    sb = t->nodes[b].seg;
+    int count = (t->segs[sb].rank - t->segs[sa].rank + k) % k + 1;
+    if (2 * count > k) {
+        list_reverse_segs(t, t->segs[sb].next, k - count);
+    } else {
+        list_reverse_segs(t, sa, count);
+    }
+    // Splits only ever move nodes to the next segment over, so sizes can
+    // drift. Start over if one got too big.
+    int s, limit = TOUR_MAX_GROWTH * (t->n / k + 1);
+    for (s = 0; s < k; s++) {
+        if (t->segs[s].size > limit) {
+            tour_path(t);
+            list_build(t);
+            return;
+        }
+    }
+}
+
+/**
+ * Reverses the part of the tour traveled when going forward from a to b
+ * (a and b included). If that part is more than half the tour, the rest of
+ * the tour is reversed instead. Both give the same round trip, just read
+ * in opposite directions, and this keeps the cost at most n/2 swaps, or
+ * O(sqrt n) steps in the list layout.
+ */
+void tour_flip(struct tour *t, int a, int b) {
+    if (t->layout == TOUR_LIST) {
+        list_flip(t, a, b);
+        return;
+    }
+    int n = t->n;
+    int i = t->pos[a], j = t->pos[b];
+    int len = (j - i + n) % n + 1;
+    if (2 * len > n) {
+        int temp = i;
+        i = j + 1 == n ? 0 : j + 1;
+        j = temp == 0 ? n - 1 : temp - 1;
+        len = n - len;
+    }
+    for (len /= 2; len > 0; len--) {
+        int ni = t->path[j], nj = t->path[i];
+        t->path[i] = ni;
+        t->pos[ni] = i;
+        t->path[j] = nj;
+        t->pos[nj] = j;
+        i = i + 1 == n ? 0 : i + 1;
+        j = j == 0 ? n - 1 : j - 1;
+    }
+}
+
+/**
+ * Replaces the edges (a,b) and (c,d) with (a,c) and (b,d).
+ * The two edges must point the same way: either b follows a and d follows
+ * c, or b comes before a and d comes before c.
+ */
+void tour_2opt_move(struct tour *t, int a, int b, int c, int d) {
+    if (tour_next(t, a) != b) {
+        // Read the tour backwards so that b follows a
+        int temp = a;
+        a = b;
+        b = temp;
+        temp = c;
+        c = d;
+        d = temp;
+    }
+    // a b ... c d  ->  a c ... b d
+    tour_flip(t, b, c);
+}
+
+/**
+ * Switches the places of nodes a and b on the tour.
+ */
+void tour_swap(struct tour *t, int a, int b) {
+    if (t->layout == TOUR_ARRAY) {
+        int i = t->pos[a], j = t->pos[b];
+        t->path[i] = b;
+        t->path[j] = a;
+        t->pos[a] = j;
+        t->pos[b] = i;
+        return;
+    }
+    if (a == b) {
+        return;
+    }
+    // Next to each other, it's the same as reversing the two
+    if (tour_next(t, a) == b) {
+        list_flip(t, a, b);
+        return;
+    }
+    if (tour_next(t, b) == a) {
+        list_flip(t, b, a);
+        return;
+    }
+    // Otherwise they trade links, segments and ranks
+    struct tour_node va = t->nodes[a], vb = t->nodes[b];
+    struct tour_seg *sa = &t->segs[va.seg], *sb = &t->segs[vb.seg];
+    int a_first = sa->first == a, a_last = sa->last == a;
+    int b_first = sb->first == b, b_last = sb->last == b;
+    if (va.prev != -1) t->nodes[va.prev].next = b;
+    if (va.next != -1) t->nodes[va.next].prev = b;
+    if (vb.prev != -1) t->nodes[vb.prev].next = a;
+    if (vb.next != -1) t->nodes[vb.next].prev = a;
+    if (a_first) sa->first = b;
+    if (a_last) sa->last = b;
+    if (b_first) sb->first = a;
+    if (b_last) sb->last = a;
+    t->nodes[a] = vb;
+    t->nodes[b] = va;
+}
@@ -0,0 +1,103 @@
+/*
+ * A round trip, stored in one of two layouts:
+ *    array: the nodes in travel order, along with the position of every
+ *           node in that array so that the neighbors of a node on the trip
+ *           can be found in O(1). Reversing part of the trip takes up to
+ *           n/2 swaps.
+ *    list: a two-level doubly-linked list. The trip is cut into about
+ *          sqrt(n) segments, each a linked list of nodes with a reversed
+ *          bit, and the segments are linked in travel order. Reversing
+ *          whole segments only flips their bits, so reversing part of the
+ *          trip takes O(sqrt n) steps. Worth it for big instances, where
+ *          the array's swaps are what most of the time goes to.
+ * Finding the next or previous node and checking whether a node is between
+ * two others are O(1) in both.
+ *
+ * Moves are described by the edges they break and create rather than by
+ * indexes, so they work no matter which direction the tour is read in.
+ */
+#ifndef TOUR_H
+#define TOUR_H
+
+// Above this many nodes tours use the list layout by default
+#define TOUR_LIST_NODE_LIMIT 50000
+
+enum tour_layout { TOUR_ARRAY, TOUR_LIST };
+
+// A node in the list layout. prev and next are the nodes before and after
+// it in its segment when the segment isn't reversed, -1 at either end.
+struct tour_node {
+    int prev, next;
+    int seg; // the segment the node is in
+    int rank; // increases along next within the segment
+};
+
+// A segment in the list layout
+struct tour_seg {
+    int reversed; // if set, the segment is traveled from last to first
+    int first, last; // the ends of the segment when it isn't reversed
+    int prev, next; // the segments before and after it in travel order
+    int rank; // 0..num_segs-1, increasing in travel order (around the trip)
+    int size; // number of nodes in the segment
+};
+
+struct tour {
+    int n; // number of nodes
+    // path[i] := the i'th node traveled to. Always up to date in the array
+    // layout; in the list layout only after tour_path.
+    int *path;
+    int *pos; // pos[node] := index of node in path, array layout only
+    enum tour_layout layout;
+    struct tour_node *nodes; // list layout only
+    struct tour_seg *segs;
+    int num_segs;
+    int *buf; // room for n nodes plus two per segment, scratch space
+};
+
+void tour_init(struct tour *t, int n, enum tour_layout layout);
+void tour_free(struct tour *t);
+void tour_update_pos(struct tour *t);
+int *tour_path(struct tour *t);
+int tour_between(const struct tour *t, int a, int b, int c);
+void tour_flip(struct tour *t, int a, int b);
+void tour_2opt_move(struct tour *t, int a, int b, int c, int d);
+void tour_swap(struct tour *t, int a, int b);
+const char *tour_layout_name(enum tour_layout layout);
+
+/**
+ * Returns the node traveled to after the given node.
+ */
+static inline int tour_next(const struct tour *t, int node) {
+    if (t->layout == TOUR_ARRAY) {
+        int i = t->pos[node] + 1;
+        return t->path[i == t->n ? 0 : i];
+    }
+    const struct tour_node *v = &t->nodes[node];
+    const struct tour_seg *s = &t->segs[v->seg];
+    int step = s->reversed ? v->prev : v->next;
+    if (step != -1) {
+        return step;
+    }
+    s = &t->segs[s->next];
+    return s->reversed ? s->last : s->first;
+}
+
+/**
+ * Returns the node traveled to before the given node.
+ */
+static inline int tour_prev(const struct tour *t, int node) {
+    if (t->layout == TOUR_ARRAY) {
+        int i = t->pos[node];
+        return t->path[i == 0 ? t->n - 1 : i - 1];
+    }
+    const struct tour_node *v = &t->nodes[node];
+    const struct tour_seg *s = &t->segs[v->seg];
+    int step = s->reversed ? v->next : v->prev;
+    if (step != -1) {
+        return step;
+    }
+    s = &t->segs[s->prev];
+    return s->reversed ? s->first : s->last;
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * State and helpers shared between main.c and the solver modules.
+ */
+#ifndef TSP_H
+#define TSP_H
+
+#include <stdint.h>
+#include "dist.h"
+
+extern int num_nodes; // number of nodes loaded
+// coords[2*i], coords[2*i+1] := x, y of node i
+extern double *coords;
+// dist(a, b) == dist(b, a) := distance from a to b
+extern struct dist_matrix dists;
+// The copy of dists the calling thread reads, on its own NUMA node if
+// there are replicas. &dists by default.
+extern _Thread_local const struct dist_matrix *thread_dists;
+
+/**
+ * Returns the distance between nodes a and b.
+ */
+static inline long long dist(int a, int b) {
+    return dist_matrix_get(thread_dists, a, b);
+}
+
+// Results of one run of the solver
+struct run_stats {
+    double seconds; // wall time from starting the threads to joining them
+    long long moves; // moves tried, each move type call or random swap
+    long long accepts; // moves that made a path shorter
+    long long len; // length of the best path found
+    // Anytime curve: the best length was lens[i] at times[i] seconds.
+    // Only changes are recorded.
+    int samples, capacity;
+    double *times;
+    long long *lens;
+};
+
+// Solver settings, see parse_args in main.c
+extern int num_threads;
+extern int island_count;
+extern uint64_t seed;
+extern int quiet;
+extern double time_limit;
+extern int num_tries;
+extern enum dist_layout dist_layout;
+extern int dist_layout_given;
+extern enum dist_width dist_width;
+
+void solve(struct run_stats *stats);
+long long find_path_len(int path[]);
+
+#endif